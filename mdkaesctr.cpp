@@ -0,0 +1,288 @@
+#include "mdkaesctr.h"
+#include <algorithm>
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+#define MDKIO_AESNI 1
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#if defined _MSC_VER
+#include <intrin.h>
+#define MDKIO_TARGET_AESNI
+#else
+#include <cpuid.h>
+#define MDKIO_TARGET_AESNI __attribute__((target("aes,ssse3")))
+#endif
+#endif
+
+namespace {
+
+const uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+/** SubBytes, ShiftRows and MixColumns as lookups, one table per row of the column */
+struct Tables {
+    uint32_t te[4][256];
+
+    Tables()
+    {
+        for (int x = 0; x < 256; ++x) {
+            const uint32_t s = SBOX[x];
+            const uint32_t s2 = ((s << 1) ^ ((s & 0x80) ? 0x1b : 0)) & 0xff;
+            const uint32_t s3 = s2 ^ s;
+            const uint32_t word = (s2 << 24) | (s << 16) | (s << 8) | s3;
+            te[0][x] = word;
+            te[1][x] = (word >> 8) | (word << 24);
+            te[2][x] = (word >> 16) | (word << 16);
+            te[3][x] = (word >> 24) | (word << 8);
+        }
+    }
+};
+
+const Tables &tables()
+{
+    static const Tables instance;
+    return instance;
+}
+
+uint32_t subWord(uint32_t word)
+{
+    return (static_cast<uint32_t>(SBOX[word >> 24]) << 24) | (static_cast<uint32_t>(SBOX[(word >> 16) & 0xff]) << 16) |
+            (static_cast<uint32_t>(SBOX[(word >> 8) & 0xff]) << 8) | SBOX[word & 0xff];
+}
+
+uint64_t bigEndian64(const uint8_t *data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+void xorBlock(uint8_t *data, const uint8_t *keyStream, int length)
+{
+    for (int i = 0; i < length; ++i) {
+        data[i] ^= keyStream[i];
+    }
+}
+
+}
+
+bool MdkAesCtr::setKey(const uint8_t *key, size_t keySize, const uint8_t *iv)
+{
+    if (keySize != 16 && keySize != 24 && keySize != 32) {
+        return false;
+    }
+
+    // FIPS-197 key expansion
+    const int keyWords = static_cast<int>(keySize / 4);
+    _rounds = keyWords + 6;
+    const int words = 4 * (_rounds + 1);
+    for (int i = 0; i < keyWords; ++i) {
+        _roundWords[i] = (static_cast<uint32_t>(key[4 * i]) << 24) | (static_cast<uint32_t>(key[4 * i + 1]) << 16) |
+                (static_cast<uint32_t>(key[4 * i + 2]) << 8) | key[4 * i + 3];
+    }
+    uint32_t roundConstant = 0x01;
+    for (int i = keyWords; i < words; ++i) {
+        uint32_t word = _roundWords[i - 1];
+        if (i % keyWords == 0) {
+            word = subWord((word << 8) | (word >> 24)) ^ (roundConstant << 24);
+            roundConstant = ((roundConstant << 1) ^ ((roundConstant & 0x80) ? 0x1b : 0)) & 0xff;
+        } else if (keyWords > 6 && i % keyWords == 4) {
+            word = subWord(word);
+        }
+        _roundWords[i] = _roundWords[i - keyWords] ^ word;
+    }
+    for (int i = 0; i < words; ++i) {
+        for (int b = 0; b < 4; ++b) {
+            _roundKeys[4 * i + b] = static_cast<uint8_t>(_roundWords[i] >> (24 - 8 * b));
+        }
+    }
+
+    _ivHigh = bigEndian64(iv);
+    _ivLow = bigEndian64(iv + 8);
+    _accelerated = hasAesNi();
+    return true;
+}
+
+void MdkAesCtr::apply(int64_t offset, uint8_t *data, int64_t length) const
+{
+    if (_rounds == 0 || offset < 0 || length <= 0) {
+        return;
+    }
+
+    uint64_t index = static_cast<uint64_t>(offset / BLOCK_SIZE);
+    uint64_t high = 0;
+    uint64_t low = 0;
+    const int skip = static_cast<int>(offset % BLOCK_SIZE);
+    if (skip > 0) {
+        uint8_t keyStream[BLOCK_SIZE];
+        counter(index++, high, low);
+        encryptBlock(high, low, keyStream);
+        const int chunk = static_cast<int>(std::min<int64_t>(BLOCK_SIZE - skip, length));
+        xorBlock(data, keyStream + skip, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+
+    const int64_t blocks = length / BLOCK_SIZE;
+    if (blocks > 0) {
+        counter(index, high, low);
+        if (_accelerated) {
+            applyAesNi(high, low, data, blocks);
+        } else {
+            applyPortable(high, low, data, blocks);
+        }
+        index += static_cast<uint64_t>(blocks);
+        data += blocks * BLOCK_SIZE;
+        length -= blocks * BLOCK_SIZE;
+    }
+
+    if (length > 0) {
+        uint8_t keyStream[BLOCK_SIZE];
+        counter(index, high, low);
+        encryptBlock(high, low, keyStream);
+        xorBlock(data, keyStream, static_cast<int>(length));
+    }
+}
+
+bool MdkAesCtr::hasAesNi()
+{
+#if defined MDKIO_AESNI && defined _MSC_VER
+    int info[4] = {};
+    __cpuid(info, 1);
+    return (info[2] & (1 << 25)) && (info[2] & (1 << 9));
+#elif defined MDKIO_AESNI
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES) && (ecx & bit_SSSE3);
+#else
+    return false;
+#endif
+}
+
+void MdkAesCtr::counter(uint64_t index, uint64_t &high, uint64_t &low) const
+{
+    low = _ivLow + index;
+    high = _ivHigh + (low < _ivLow ? 1 : 0);
+}
+
+void MdkAesCtr::encryptBlock(uint64_t high, uint64_t low, uint8_t *out) const
+{
+    const Tables &t = tables();
+    const uint32_t *key = _roundWords;
+    uint32_t s0 = static_cast<uint32_t>(high >> 32) ^ key[0];
+    uint32_t s1 = static_cast<uint32_t>(high) ^ key[1];
+    uint32_t s2 = static_cast<uint32_t>(low >> 32) ^ key[2];
+    uint32_t s3 = static_cast<uint32_t>(low) ^ key[3];
+    for (int round = 1; round < _rounds; ++round) {
+        key += 4;
+        const uint32_t t0 = t.te[0][s0 >> 24] ^ t.te[1][(s1 >> 16) & 0xff] ^ t.te[2][(s2 >> 8) & 0xff] ^ t.te[3][s3 & 0xff] ^ key[0];
+        const uint32_t t1 = t.te[0][s1 >> 24] ^ t.te[1][(s2 >> 16) & 0xff] ^ t.te[2][(s3 >> 8) & 0xff] ^ t.te[3][s0 & 0xff] ^ key[1];
+        const uint32_t t2 = t.te[0][s2 >> 24] ^ t.te[1][(s3 >> 16) & 0xff] ^ t.te[2][(s0 >> 8) & 0xff] ^ t.te[3][s1 & 0xff] ^ key[2];
+        const uint32_t t3 = t.te[0][s3 >> 24] ^ t.te[1][(s0 >> 16) & 0xff] ^ t.te[2][(s1 >> 8) & 0xff] ^ t.te[3][s2 & 0xff] ^ key[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no MixColumns
+    key += 4;
+    const uint32_t state[4] = {s0, s1, s2, s3};
+    for (int column = 0; column < 4; ++column) {
+        const uint32_t word = (static_cast<uint32_t>(SBOX[state[column] >> 24]) << 24) ^
+                (static_cast<uint32_t>(SBOX[(state[(column + 1) % 4] >> 16) & 0xff]) << 16) ^
+                (static_cast<uint32_t>(SBOX[(state[(column + 2) % 4] >> 8) & 0xff]) << 8) ^
+                SBOX[state[(column + 3) % 4] & 0xff] ^ key[column];
+        out[4 * column] = static_cast<uint8_t>(word >> 24);
+        out[4 * column + 1] = static_cast<uint8_t>(word >> 16);
+        out[4 * column + 2] = static_cast<uint8_t>(word >> 8);
+        out[4 * column + 3] = static_cast<uint8_t>(word);
+    }
+}
+
+void MdkAesCtr::applyPortable(uint64_t high, uint64_t low, uint8_t *data, int64_t blocks) const
+{
+    uint8_t keyStream[BLOCK_SIZE];
+    for (int64_t block = 0; block < blocks; ++block) {
+        encryptBlock(high, low, keyStream);
+        xorBlock(data + block * BLOCK_SIZE, keyStream, BLOCK_SIZE);
+        if (++low == 0) {
+            ++high;
+        }
+    }
+}
+
+#if defined MDKIO_AESNI
+MDKIO_TARGET_AESNI
+void MdkAesCtr::applyAesNi(uint64_t high, uint64_t low, uint8_t *data, int64_t blocks) const
+{
+    // Reverses the bytes, turning the counter into a big endian block
+    const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i keys[15];
+    for (int round = 0; round <= _rounds; ++round) {
+        keys[round] = _mm_load_si128(reinterpret_cast<const __m128i*>(_roundKeys) + round);
+    }
+
+    // Independent blocks, so the rounds of one overlap with those of the others
+    while (blocks >= PARALLEL_BLOCKS) {
+        __m128i state[PARALLEL_BLOCKS];
+        for (int i = 0; i < PARALLEL_BLOCKS; ++i) {
+            const __m128i block = _mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low));
+            state[i] = _mm_xor_si128(_mm_shuffle_epi8(block, swap), keys[0]);
+            if (++low == 0) {
+                ++high;
+            }
+        }
+        for (int round = 1; round < _rounds; ++round) {
+            for (int i = 0; i < PARALLEL_BLOCKS; ++i) {
+                state[i] = _mm_aesenc_si128(state[i], keys[round]);
+            }
+        }
+        for (int i = 0; i < PARALLEL_BLOCKS; ++i) {
+            __m128i *block = reinterpret_cast<__m128i*>(data) + i;
+            state[i] = _mm_aesenclast_si128(state[i], keys[_rounds]);
+            _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), state[i]));
+        }
+        data += PARALLEL_BLOCKS * BLOCK_SIZE;
+        blocks -= PARALLEL_BLOCKS;
+    }
+
+    for (; blocks > 0; --blocks) {
+        const __m128i counterBlock = _mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low));
+        __m128i state = _mm_xor_si128(_mm_shuffle_epi8(counterBlock, swap), keys[0]);
+        for (int round = 1; round < _rounds; ++round) {
+            state = _mm_aesenc_si128(state, keys[round]);
+        }
+        __m128i *block = reinterpret_cast<__m128i*>(data);
+        state = _mm_aesenclast_si128(state, keys[_rounds]);
+        _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), state));
+        data += BLOCK_SIZE;
+        if (++low == 0) {
+            ++high;
+        }
+    }
+}
+#else
+void MdkAesCtr::applyAesNi(uint64_t high, uint64_t low, uint8_t *data, int64_t blocks) const
+{
+    applyPortable(high, low, data, blocks);
+}
+#endif
@@ -0,0 +1,57 @@
+#ifndef MDKAESCTR_H
+#define MDKAESCTR_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * AES in counter mode (NIST SP 800-38A), decrypting or encrypting data in
+ * place at any offset of the stream.
+ *
+ * The counter block for offset is the initial counter block plus offset /
+ * BLOCK_SIZE, as a 128-bit big endian number, so seeking needs nothing but
+ * the offset. On x86 CPUs with AES-NI, PARALLEL_BLOCKS counter blocks are
+ * encrypted at once to keep the AES unit busy; elsewhere a portable table
+ * based implementation is used.
+ */
+class MdkAesCtr
+{
+public:
+    static constexpr int BLOCK_SIZE = 16;
+    /** Blocks encrypted at once by the AES-NI kernel */
+    static constexpr int PARALLEL_BLOCKS = 8;
+
+    /**
+     * Set a key of 16, 24 or 32 bytes (AES-128, AES-192 or AES-256) and the
+     * initial counter block. Returns false for other key sizes.
+     */
+    bool setKey(const uint8_t *key, size_t keySize, const uint8_t *iv);
+
+    /** XOR length bytes of data, at offset in the stream, with the key stream */
+    void apply(int64_t offset, uint8_t *data, int64_t length) const;
+
+    /** Whether the AES-NI kernel is used */
+    bool isAccelerated() const { return _accelerated; }
+
+    /** Force the portable implementation, for comparing against it */
+    void setAccelerated(bool accelerated) { _accelerated = accelerated && hasAesNi(); }
+
+    static bool hasAesNi();
+
+private:
+    /** Counter block for block index, as high and low 64 bits */
+    void counter(uint64_t index, uint64_t &high, uint64_t &low) const;
+    void encryptBlock(uint64_t high, uint64_t low, uint8_t *out) const;
+    void applyPortable(uint64_t high, uint64_t low, uint8_t *data, int64_t blocks) const;
+    void applyAesNi(uint64_t high, uint64_t low, uint8_t *data, int64_t blocks) const;
+
+    int _rounds = 0;
+    /** Round keys as bytes for AES-NI, and as big endian words for the tables */
+    alignas(16) uint8_t _roundKeys[15 * BLOCK_SIZE] = {};
+    uint32_t _roundWords[15 * 4] = {};
+    uint64_t _ivHigh = 0;
+    uint64_t _ivLow = 0;
+    bool _accelerated = false;
+};
+
+#endif // MDKAESCTR_H
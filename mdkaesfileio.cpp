@@ -0,0 +1,117 @@
+#include "mdkaesfileio.h"
+#include "mdktrace.h"
+#include <QtCore/QByteArray>
+#include <QtCore/QUrl>
+#include <QtCore/QUrlQuery>
+
+namespace {
+
+/** Hex value of the url query item key, otherwise of the MDK global option "MdkAesFileIO.<key>" */
+QByteArray hexOption(const QUrlQuery &query, const char *key)
+{
+    if (query.hasQueryItem(key)) {
+        return QByteArray::fromHex(query.queryItemValue(key).toLatin1());
+    }
+
+    const MDK_NS::OptionVal value = MDK_NS::GetGlobalOption((std::string(MdkAesFileIO::NAME) + "." + key).c_str());
+    if (const auto *text = std::get_if<std::string>(&value)) {
+        return QByteArray::fromHex(QByteArray(text->c_str()));
+    }
+    return QByteArray();
+}
+
+}
+
+MdkAesFileIO::MdkAesFileIO():
+    mdk::MediaIO()
+{
+    // empty
+}
+
+void MdkAesFileIO::registerOnce()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkAesFileIO");
+    MediaIO::registerOnce(NAME, []{ return new MdkAesFileIO();});
+}
+
+const char *MdkAesFileIO::name() const
+{
+    return NAME;
+}
+
+const std::set<std::string> &MdkAesFileIO::protocols() const {
+    static const std::set<std::string> s{PROTOCOL};
+    return s;
+}
+
+int64_t MdkAesFileIO::read(uint8_t *data, int64_t maxSize)
+{
+    if (!_keySet) {
+        return -1;
+    }
+
+    const int64_t bytesRead = _file.read(data, maxSize);
+    if (bytesRead > 0) {
+        MDKIO_TRACE_SPAN(span, "decrypt");
+        _cipher.apply(_position, data, bytesRead);
+        _position += bytesRead;
+        MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+    }
+    return bytesRead;
+}
+
+bool MdkAesFileIO::seek(int64_t offset, int from)
+{
+    int64_t position = offset;
+    if (from == SEEK_CUR) {
+        position += _position;
+    } else if (from == SEEK_END) {
+        position += _file.size();
+    }
+    if (!_file.seek(position, SEEK_SET)) {
+        return false;
+    }
+    _position = position;
+    return true;
+}
+
+int64_t MdkAesFileIO::position() const
+{
+    return _position;
+}
+
+int64_t MdkAesFileIO::size() const
+{
+    return _file.size();
+}
+
+bool MdkAesFileIO::onUrlChanged()
+{
+    _keySet = false;
+    _position = 0;
+    if (url().empty()) {
+        return _file.setUrl(std::string());
+    }
+
+    // The key stays out of the url MdkLocalFileIO sees, which it may put in events
+    QUrl fileUrl(QString::fromStdString(url()));
+    QUrlQuery query(fileUrl);
+    const QByteArray key = hexOption(query, "key");
+    const QByteArray iv = hexOption(query, "iv");
+    query.removeAllQueryItems("key");
+    query.removeAllQueryItems("iv");
+    fileUrl.setQuery(query);
+    fileUrl.setScheme(MdkLocalFileIO::PROTOCOL);
+
+    if (iv.size() != MdkAesCtr::BLOCK_SIZE ||
+            !_cipher.setKey(reinterpret_cast<const uint8_t*>(key.constData()), static_cast<size_t>(key.size()),
+                            reinterpret_cast<const uint8_t*>(iv.constData()))) {
+        MDKIO_TRACE(MDK_NS::Warning, "Missing or invalid AES key or iv for %s", qPrintable(fileUrl.toString()));
+        return false;
+    }
+    _keySet = true;
+    MDKIO_TRACE(MDK_NS::Debug, "Decrypting %s %s AES-NI", qPrintable(fileUrl.toString()), _cipher.isAccelerated() ? "with" : "without");
+
+    _file.setBufferSize(bufferSize());
+    return _file.setUrl(fileUrl.toString().toStdString());
+}
@@ -0,0 +1,72 @@
+#ifndef MDKAESFILEIO_H
+#define MDKAESFILEIO_H
+
+#include <memory>
+#include <set>
+
+#include "mdkaesctr.h"
+#include "mdklocalfileio.h"
+
+/**
+ * MediaIO for local files encrypted with AES-CTR, for urls like
+ * localfile+aes:///videos/ride.mp4?key=<hex>&iv=<hex>
+ *
+ * The whole file is one AES-CTR stream. "key" is the 16, 24 or 32 byte key
+ * and "iv" the 16 byte initial counter block, both in hex; they can also be
+ * set for all urls with SetGlobalOption("MdkAesFileIO.key", ...) and
+ * "MdkAesFileIO.iv", which keeps them out of urls that end up in logs.
+ *
+ * The file is read through an MdkLocalFileIO, so all of its query items
+ * apply, and decrypted in place in the buffer passed to read(). Seeking
+ * only needs the offset to find the counter, see MdkAesCtr.
+ */
+class MdkAesFileIO: public MDK_NS::MediaIO
+{
+public:
+    static constexpr char const * NAME = "MdkAesFileIO";
+    static constexpr char const * PROTOCOL = "localfile+aes";
+
+    MdkAesFileIO();
+
+    ~MdkAesFileIO() override = default;
+
+    static void registerOnce();
+
+    const char* name() const override;
+
+    const std::set<std::string> &protocols() const override;
+
+    /** Always seekable! */
+    bool isSeekable() const override { return true; }
+    /** We don't need or want any writing done */
+    bool isWritable() const override { return false; }
+
+    /** Read and decrypt */
+    int64_t read(uint8_t *data, int64_t maxSize) override;
+
+    /** No writing is possible */
+    int64_t write(const uint8_t *, int64_t) override { return 0; }
+
+    /** Seek in file */
+    bool seek(int64_t offset, int from = SEEK_SET) override;
+
+    /** Get the current position */
+    int64_t position() const override;
+
+    /** Get the size of the video file */
+    int64_t size() const override;
+
+    /** Whether the AES-NI kernel is used */
+    bool isAccelerated() const { return _cipher.isAccelerated(); }
+
+protected:
+    bool onUrlChanged() override;
+private:
+    MdkLocalFileIO _file;
+    MdkAesCtr _cipher;
+    bool _keySet = false;
+    /** Position in the stream, to find the counter for the next read */
+    int64_t _position = 0;
+};
+
+#endif // MDKAESFILEIO_H
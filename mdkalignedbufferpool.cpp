@@ -0,0 +1,49 @@
+#include "mdkalignedbufferpool.h"
+#include "mdkblockarena.h"
+
+namespace {
+
+uint8_t *allocateAligned()
+{
+    static_assert(MdkAlignedBufferPool::BUFFER_SIZE == MdkBlockArena::BLOCK_SIZE, "buffers are arena blocks");
+    static_assert(MdkAlignedBufferPool::ALIGNMENT <= 4096, "arena blocks are page aligned");
+    return static_cast<uint8_t*>(MdkBlockArena::instance().allocate(MdkAlignedBufferPool::BUFFER_SIZE));
+}
+
+}
+
+void MdkAlignedBufferPool::Deleter::operator()(uint8_t *buffer) const
+{
+    MdkAlignedBufferPool::instance().release(buffer);
+}
+
+MdkAlignedBufferPool &MdkAlignedBufferPool::instance()
+{
+    static MdkAlignedBufferPool pool;
+    return pool;
+}
+
+MdkAlignedBufferPool::Buffer MdkAlignedBufferPool::acquire()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_idle.empty()) {
+            uint8_t *buffer = _idle.back();
+            _idle.pop_back();
+            return Buffer(buffer);
+        }
+    }
+    return Buffer(allocateAligned());
+}
+
+void MdkAlignedBufferPool::release(uint8_t *buffer)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_idle.size() < MAX_IDLE_BUFFERS) {
+            _idle.push_back(buffer);
+            return;
+        }
+    }
+    MdkBlockArena::instance().release(buffer, BUFFER_SIZE);
+}
@@ -0,0 +1,44 @@
+#ifndef MDKALIGNEDBUFFERPOOL_H
+#define MDKALIGNEDBUFFERPOOL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Process-wide pool of page-aligned buffers, as needed for O_DIRECT reads.
+ *
+ * Buffers are kept when released, so playing files back to back does not
+ * allocate and free large aligned blocks for every file. They are blocks
+ * of MdkBlockArena, so there are none when it is full.
+ */
+class MdkAlignedBufferPool
+{
+public:
+    /** Alignment of the buffers, also the alignment required for O_DIRECT offsets and sizes */
+    static constexpr int64_t ALIGNMENT = 4096;
+    /** Size of every buffer in the pool */
+    static constexpr int64_t BUFFER_SIZE = 1024 * 1024;
+    /** Number of released buffers that are kept for reuse */
+    static constexpr size_t MAX_IDLE_BUFFERS = 8;
+
+    struct Deleter {
+        void operator()(uint8_t *buffer) const;
+    };
+    using Buffer = std::unique_ptr<uint8_t, Deleter>;
+
+    static MdkAlignedBufferPool &instance();
+
+    /** Get a buffer of BUFFER_SIZE bytes, aligned to ALIGNMENT. nullptr if out of memory. */
+    Buffer acquire();
+
+private:
+    MdkAlignedBufferPool() = default;
+    void release(uint8_t *buffer);
+
+    std::mutex _mutex;
+    std::vector<uint8_t*> _idle;
+};
+
+#endif // MDKALIGNEDBUFFERPOOL_H
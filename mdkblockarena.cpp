@@ -0,0 +1,305 @@
+#include "mdkblockarena.h"
+#include "mdktrace.h"
+#include <new>
+#include <QtCore/QtGlobal>
+
+#if defined Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+/** Slabs are aligned to this, so they can be backed by huge pages */
+constexpr int64_t SLAB_ALIGNMENT = 2 * 1024 * 1024;
+
+/**
+ * Set when the thread's cache is destroyed. Static objects holding blocks,
+ * like MdkPreloader, are destroyed after the main thread's thread_local
+ * objects, and release them straight to the arena then. Being trivially
+ * destructible, this can still be read at that point.
+ */
+thread_local bool threadCacheDestroyed = false;
+
+}
+
+struct MdkBlockArena::ThreadCache {
+    std::vector<uint8_t*> blocks;
+
+    ~ThreadCache()
+    {
+        threadCacheDestroyed = true;
+        MdkBlockArena::instance().drain(*this, 0);
+    }
+};
+
+MdkBlockArena::Data::~Data()
+{
+    clear();
+}
+
+MdkBlockArena::Data::Data(Data &&other) noexcept:
+    _data(other._data),
+    _size(other._size)
+{
+    other._data = nullptr;
+    other._size = 0;
+}
+
+MdkBlockArena::Data &MdkBlockArena::Data::operator=(Data &&other) noexcept
+{
+    if (this != &other) {
+        clear();
+        _data = other._data;
+        _size = other._size;
+        other._data = nullptr;
+        other._size = 0;
+    }
+    return *this;
+}
+
+bool MdkBlockArena::Data::allocate(size_t size)
+{
+    clear();
+    const int64_t bytes = static_cast<int64_t>(size);
+    if (bytes == 0) {
+        return true;
+    }
+    if (bytes > BLOCK_SIZE) {
+        return false;
+    }
+
+    _data = bytes > BLOCK_SIZE / 2 ? static_cast<uint8_t*>(instance().allocate(bytes)) : new (std::nothrow) uint8_t[size];
+    if (_data == nullptr) {
+        return false;
+    }
+    _size = size;
+    return true;
+}
+
+void MdkBlockArena::Data::clear()
+{
+    if (_data != nullptr && !instance().release(_data, static_cast<int64_t>(_size))) {
+        delete[] _data;
+    }
+    _data = nullptr;
+    _size = 0;
+}
+
+double MdkBlockArena::Stats::fragmentation() const
+{
+    if (committedBytes <= 0) {
+        return 0;
+    }
+    return 1.0 - static_cast<double>(requestedBytes) / static_cast<double>(committedBytes);
+}
+
+std::string MdkBlockArena::Stats::toString() const
+{
+    return "arenaCommitted=" + std::to_string(committedBytes) +
+            " arenaInUse=" + std::to_string(inUseBlocks * BLOCK_SIZE) +
+            " arenaPeak=" + std::to_string(peakInUseBlocks * BLOCK_SIZE) +
+            " arenaFragmentation=" + std::to_string(fragmentation()) +
+            " arenaFailures=" + std::to_string(failures);
+}
+
+MdkBlockArena::MdkBlockArena():
+    _capacity(DEFAULT_CAPACITY)
+{
+    // empty
+}
+
+MdkBlockArena &MdkBlockArena::instance()
+{
+    // Never destroyed, threads return their cached blocks when they exit
+    static MdkBlockArena *arena = new MdkBlockArena();
+    return *arena;
+}
+
+void MdkBlockArena::setCapacity(int64_t capacity)
+{
+    MdkBlockArena &arena = instance();
+    std::lock_guard<std::mutex> lock(arena._mutex);
+    if (!arena._reserved) {
+        arena._capacity = qMax<int64_t>(0, capacity) / (SLAB_BLOCKS * BLOCK_SIZE) * (SLAB_BLOCKS * BLOCK_SIZE);
+    }
+}
+
+void *MdkBlockArena::allocate(int64_t requested)
+{
+    uint8_t *block = nullptr;
+    if (ThreadCache *cache = threadCache()) {
+        if (cache->blocks.empty()) {
+            refill(*cache);
+        }
+        if (!cache->blocks.empty()) {
+            block = cache->blocks.back();
+            cache->blocks.pop_back();
+        }
+    } else {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_free.empty() || commitSlab()) {
+            block = _free.back();
+            _free.pop_back();
+        }
+    }
+
+    if (block == nullptr) {
+        _failures.fetch_add(1, std::memory_order_relaxed);
+        if (!_exhausted.exchange(true, std::memory_order_relaxed)) {
+            MDKIO_TRACE(MDK_NS::Warning, "Block arena of %lld MB is full, refusing allocations",
+                        static_cast<long long>(_capacity.load(std::memory_order_relaxed) / BLOCK_SIZE));
+        }
+        return nullptr;
+    }
+    if (_exhausted.load(std::memory_order_relaxed)) {
+        _exhausted.store(false, std::memory_order_relaxed);
+    }
+
+    const int64_t inUse = _inUse.fetch_add(1, std::memory_order_relaxed) + 1;
+    int64_t peak = _peakInUse.load(std::memory_order_relaxed);
+    while (inUse > peak && !_peakInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+        // retry with the updated peak
+    }
+    _requested.fetch_add(requested, std::memory_order_relaxed);
+    return block;
+}
+
+bool MdkBlockArena::release(void *pointer, int64_t requested)
+{
+    if (!owns(pointer)) {
+        return false;
+    }
+
+    _inUse.fetch_sub(1, std::memory_order_relaxed);
+    _requested.fetch_sub(requested, std::memory_order_relaxed);
+    ThreadCache *cache = threadCache();
+    if (cache == nullptr) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(static_cast<uint8_t*>(pointer));
+        return true;
+    }
+
+    cache->blocks.push_back(static_cast<uint8_t*>(pointer));
+    if (_exhausted.load(std::memory_order_relaxed)) {
+        // Another thread is short of blocks, hand them all back
+        drain(*cache, 0);
+    } else if (cache->blocks.size() > THREAD_CACHE_BLOCKS) {
+        drain(*cache, THREAD_CACHE_BLOCKS / 2);
+    }
+    return true;
+}
+
+bool MdkBlockArena::owns(const void *pointer) const
+{
+    const uint8_t *base = _base.load(std::memory_order_acquire);
+    const uint8_t *byte = static_cast<const uint8_t*>(pointer);
+    return base != nullptr && byte >= base && byte < base + _capacity.load(std::memory_order_relaxed);
+}
+
+MdkBlockArena::Stats MdkBlockArena::stats() const
+{
+    Stats stats;
+    stats.capacity = _capacity.load(std::memory_order_relaxed);
+    stats.committedBytes = _committed.load(std::memory_order_relaxed);
+    stats.inUseBlocks = _inUse.load(std::memory_order_relaxed);
+    stats.peakInUseBlocks = _peakInUse.load(std::memory_order_relaxed);
+    stats.requestedBytes = _requested.load(std::memory_order_relaxed);
+    stats.failures = _failures.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool MdkBlockArena::reserve()
+{
+    const int64_t capacity = _capacity.load(std::memory_order_relaxed);
+    if (capacity <= 0) {
+        return false;
+    }
+
+#if defined Q_OS_WIN
+    // VirtualAlloc reservations are aligned to 64 KB, huge pages need special privileges anyway
+    void *range = VirtualAlloc(nullptr, static_cast<SIZE_T>(capacity), MEM_RESERVE, PAGE_NOACCESS);
+    if (range == nullptr) {
+        return false;
+    }
+    _base.store(static_cast<uint8_t*>(range), std::memory_order_release);
+#else
+    void *range = mmap(nullptr, static_cast<size_t>(capacity + SLAB_ALIGNMENT), PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range == MAP_FAILED) {
+        return false;
+    }
+    const uintptr_t address = reinterpret_cast<uintptr_t>(range);
+    const uintptr_t aligned = (address + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+    _base.store(reinterpret_cast<uint8_t*>(aligned), std::memory_order_release);
+#endif
+    return true;
+}
+
+bool MdkBlockArena::commitSlab()
+{
+    if (!_reserved) {
+        _reserved = true;
+        if (!reserve()) {
+            _capacity = 0;
+            return false;
+        }
+    }
+
+    const int64_t committed = _committed.load(std::memory_order_relaxed);
+    const int64_t slabSize = SLAB_BLOCKS * BLOCK_SIZE;
+    if (committed + slabSize > _capacity.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    uint8_t *slab = _base.load(std::memory_order_relaxed) + committed;
+#if defined Q_OS_WIN
+    if (VirtualAlloc(slab, static_cast<SIZE_T>(slabSize), MEM_COMMIT, PAGE_READWRITE) == nullptr) {
+        return false;
+    }
+#else
+    if (mprotect(slab, static_cast<size_t>(slabSize), PROT_READ | PROT_WRITE) != 0) {
+        return false;
+    }
+#if defined MADV_HUGEPAGE
+    madvise(slab, static_cast<size_t>(slabSize), MADV_HUGEPAGE);
+#endif
+#endif
+
+    for (int64_t i = SLAB_BLOCKS - 1; i >= 0; --i) {
+        _free.push_back(slab + i * BLOCK_SIZE);
+    }
+    _committed.store(committed + slabSize, std::memory_order_relaxed);
+    return true;
+}
+
+void MdkBlockArena::refill(ThreadCache &cache)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_free.empty() && !commitSlab()) {
+        return;
+    }
+    const size_t count = qMin(_free.size(), THREAD_CACHE_BLOCKS / 2);
+    cache.blocks.insert(cache.blocks.end(), _free.end() - static_cast<std::ptrdiff_t>(count), _free.end());
+    _free.resize(_free.size() - count);
+}
+
+void MdkBlockArena::drain(ThreadCache &cache, size_t keep)
+{
+    if (cache.blocks.size() <= keep) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _free.insert(_free.end(), cache.blocks.begin() + static_cast<std::ptrdiff_t>(keep), cache.blocks.end());
+    cache.blocks.resize(keep);
+}
+
+MdkBlockArena::ThreadCache *MdkBlockArena::threadCache()
+{
+    if (threadCacheDestroyed) {
+        return nullptr;
+    }
+    static thread_local ThreadCache cache;
+    return &cache;
+}
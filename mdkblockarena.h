@@ -0,0 +1,145 @@
+#ifndef MDKBLOCKARENA_H
+#define MDKBLOCKARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Process-wide slab allocator for the 1 MB blocks of the I/O layer.
+ *
+ * Read-ahead blocks, cache blocks and direct I/O buffers all have the same
+ * size and are allocated and freed continuously during playback. Taking
+ * them from malloc fragments the heap of a process that runs for hours, so
+ * they come from one reserved address range instead. The range is committed
+ * in slabs of SLAB_BLOCKS blocks, backed by transparent huge pages where
+ * available, and never returned, so resident memory grows to the peak use
+ * and then stays flat.
+ *
+ * Every thread keeps a few free blocks of its own, so the demux and
+ * prefetch threads only take the arena lock to exchange batches of blocks.
+ * The capacity is a hard limit: once it is used up, allocate() returns
+ * nullptr and counts a failure, and threads hand every released block back
+ * to the arena until allocations succeed again. Running into it slows
+ * reading down rather than failing it: callers evict from their block
+ * cache and try again, and otherwise read the data straight into the
+ * caller's buffer, without buffering it.
+ */
+class MdkBlockArena
+{
+public:
+    /** Size of every block, equal to MdkReadAhead::BLOCK_SIZE */
+    static constexpr int64_t BLOCK_SIZE = 1024 * 1024;
+    /** Blocks committed at once, a multiple of the 2 MB huge page size */
+    static constexpr int64_t SLAB_BLOCKS = 16;
+    /** Default capacity, see setCapacity() */
+    static constexpr int64_t DEFAULT_CAPACITY = 512 * 1024 * 1024;
+    /** Free blocks kept per thread before half of them go back to the arena */
+    static constexpr size_t THREAD_CACHE_BLOCKS = 8;
+
+    struct Stats {
+        int64_t capacity = 0;
+        /** Bytes committed, the resident memory of the arena */
+        int64_t committedBytes = 0;
+        int64_t inUseBlocks = 0;
+        int64_t peakInUseBlocks = 0;
+        /** Bytes actually requested for the blocks in use */
+        int64_t requestedBytes = 0;
+        /** Allocations refused because the arena was full */
+        uint64_t failures = 0;
+
+        /** Part of the committed memory not holding requested data, 0 to 1 */
+        double fragmentation() const;
+        /** Compact key=value form, as used in the detail of stats events */
+        std::string toString() const;
+    };
+
+    /**
+     * Block data as used by the read-ahead and the block cache, empty until
+     * allocate() succeeds. Sizes of more than half and up to BLOCK_SIZE
+     * bytes take a block from the arena. Smaller ones, like the tail of a
+     * file, would waste most of a block and come from the heap.
+     */
+    class Data
+    {
+    public:
+        Data() = default;
+        ~Data();
+
+        Data(Data &&other) noexcept;
+        Data &operator=(Data &&other) noexcept;
+        Data(const Data &) = delete;
+        Data &operator=(const Data &) = delete;
+
+        /**
+         * Allocate size bytes, not initialised, in place of the current
+         * data. False if the arena is full or size is over BLOCK_SIZE,
+         * leaving it empty.
+         */
+        bool allocate(size_t size);
+
+        /** Free the data */
+        void clear();
+
+        uint8_t *data() { return _data; }
+        const uint8_t *data() const { return _data; }
+        size_t size() const { return _size; }
+        bool empty() const { return _size == 0; }
+
+    private:
+        uint8_t *_data = nullptr;
+        size_t _size = 0;
+    };
+
+    static MdkBlockArena &instance();
+
+    /**
+     * Set the capacity in bytes. Only has effect before the first block is
+     * allocated, as the address range is reserved then.
+     */
+    static void setCapacity(int64_t capacity);
+
+    /**
+     * Get a block for up to BLOCK_SIZE bytes, aligned to at least 4096 bytes.
+     * nullptr if the arena is full.
+     */
+    void *allocate(int64_t requested);
+
+    /** Return a block from allocate(). Returns false if pointer isn't from the arena. */
+    bool release(void *pointer, int64_t requested);
+
+    /** Whether pointer was allocated from the arena */
+    bool owns(const void *pointer) const;
+
+    Stats stats() const;
+
+private:
+    struct ThreadCache;
+
+    MdkBlockArena();
+    bool reserve();
+    bool commitSlab();
+    void refill(ThreadCache &cache);
+    void drain(ThreadCache &cache, size_t keep);
+    /** The calling thread's cache, nullptr once it has been destroyed as the thread exits */
+    static ThreadCache *threadCache();
+
+    std::mutex _mutex;
+    std::vector<uint8_t*> _free;
+    bool _reserved = false;
+
+    std::atomic<uint8_t*> _base{nullptr};
+    std::atomic<int64_t> _capacity{0};
+    std::atomic<int64_t> _committed{0};
+    std::atomic<int64_t> _inUse{0};
+    std::atomic<int64_t> _peakInUse{0};
+    std::atomic<int64_t> _requested{0};
+    std::atomic<uint64_t> _failures{0};
+    /** Set when an allocation fails, until one succeeds, to have threads return their cached blocks */
+    std::atomic<bool> _exhausted{false};
+};
+
+#endif // MDKBLOCKARENA_H
@@ -0,0 +1,141 @@
+#include "mdkblockcache.h"
+#include <iterator>
+
+MdkBlockCache::MdkBlockCache(int64_t budget, int64_t blockSize):
+    _budget(budget),
+    _blockSize(blockSize)
+{
+    // empty
+}
+
+MdkBlockCache::Block MdkBlockCache::find(int64_t offset)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(offset);
+    if (it == _entries.end()) {
+        ++_stats.misses;
+        return nullptr;
+    }
+    ++_stats.hits;
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return it->second.block;
+}
+
+void MdkBlockCache::insert(int64_t offset, Block block)
+{
+    if (!block || static_cast<int64_t>(block->size()) > _budget) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto it = _entries.find(offset);
+    if (it != _entries.end()) {
+        // Already cached, possibly by another reader. Keep the existing one.
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+        return;
+    }
+
+    _lru.push_front(offset);
+    Entry &entry = _entries[offset];
+    entry.block = std::move(block);
+    entry.lru = _lru.begin();
+    _stats.residentBytes += static_cast<int64_t>(entry.block->size());
+
+    auto seekCount = _seekCounts.find(offset);
+    if (seekCount != _seekCounts.end() && seekCount->second >= PIN_SEEK_COUNT) {
+        pin(entry);
+    }
+
+    while (_stats.residentBytes > _budget) {
+        evict();
+    }
+}
+
+bool MdkBlockCache::evictOne()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_lru.empty()) {
+        return false;
+    }
+    evict();
+    return true;
+}
+
+void MdkBlockCache::noteSeek(int64_t position)
+{
+    const int64_t offset = position - position % _blockSize;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_seekCounts.size() >= MAX_SEEK_HISTORY && _seekCounts.find(offset) == _seekCounts.end()) {
+        ageSeekCounts();
+    }
+    const uint32_t count = ++_seekCounts[offset];
+
+    auto it = _entries.find(offset);
+    if (it != _entries.end() && count >= PIN_SEEK_COUNT) {
+        pin(it->second);
+    }
+}
+
+void MdkBlockCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _lru.clear();
+    _entries.clear();
+    _seekCounts.clear();
+    _stats.residentBytes = 0;
+    _stats.pinnedBytes = 0;
+}
+
+MdkBlockCache::Stats MdkBlockCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void MdkBlockCache::pin(Entry &entry)
+{
+    if (!entry.pinned) {
+        entry.pinned = true;
+        _stats.pinnedBytes += static_cast<int64_t>(entry.block->size());
+    }
+}
+
+void MdkBlockCache::evict()
+{
+    // Least recently used unpinned block, unless pinned blocks take more than half the budget
+    auto victim = _lru.end();
+    const bool preferPinned = _stats.pinnedBytes > _budget / 2;
+    for (auto it = _lru.rbegin(); it != _lru.rend(); ++it) {
+        if (_entries[*it].pinned == preferPinned) {
+            victim = std::prev(it.base());
+            break;
+        }
+    }
+    if (victim == _lru.end()) {
+        victim = std::prev(_lru.end());
+    }
+
+    auto entry = _entries.find(*victim);
+    const int64_t size = static_cast<int64_t>(entry->second.block->size());
+    _stats.residentBytes -= size;
+    if (entry->second.pinned) {
+        _stats.pinnedBytes -= size;
+        ++_stats.pinnedEvictions;
+    }
+    ++_stats.evictions;
+    _entries.erase(entry);
+    _lru.erase(victim);
+}
+
+void MdkBlockCache::ageSeekCounts()
+{
+    for (auto it = _seekCounts.begin(); it != _seekCounts.end();) {
+        it->second /= 2;
+        if (it->second == 0) {
+            it = _seekCounts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
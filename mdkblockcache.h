@@ -0,0 +1,91 @@
+#ifndef MDKBLOCKCACHE_H
+#define MDKBLOCKCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "mdkblockarena.h"
+
+/**
+ * Memory bounded LRU cache of fixed-size file blocks, keyed by file offset.
+ *
+ * Blocks that seeks land on repeatedly (moov atoms, GOP starts) are pinned:
+ * they are only evicted when there are no unpinned blocks left, or when
+ * pinned blocks take up more than half of the budget.
+ *
+ * The cache is thread-safe, so it can be filled from a prefetch thread.
+ */
+class MdkBlockCache
+{
+public:
+    using Block = std::shared_ptr<const MdkBlockArena::Data>;
+
+    /** Number of seeks landing in a block before it is pinned */
+    static constexpr uint32_t PIN_SEEK_COUNT = 2;
+    /** Number of blocks for which seeks are remembered before old counts are aged */
+    static constexpr size_t MAX_SEEK_HISTORY = 4096;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t pinnedEvictions = 0;
+        int64_t residentBytes = 0;
+        int64_t pinnedBytes = 0;
+    };
+
+    MdkBlockCache(int64_t budget, int64_t blockSize);
+
+    MdkBlockCache(const MdkBlockCache &) = delete;
+    MdkBlockCache &operator=(const MdkBlockCache &) = delete;
+
+    int64_t blockSize() const { return _blockSize; }
+    int64_t budget() const { return _budget; }
+
+    /** Get the block starting at offset, or nullptr if it is not cached */
+    Block find(int64_t offset);
+
+    /** Add the block starting at offset, evicting others if over budget */
+    void insert(int64_t offset, Block block);
+
+    /**
+     * Evict the block that would be evicted next, to give its memory back
+     * when the arena is full. Returns false if the cache is empty.
+     */
+    bool evictOne();
+
+    /** Record that a seek landed at position. Repeated seeks pin the block. */
+    void noteSeek(int64_t position);
+
+    /** Drop all blocks and the seek history */
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        Block block;
+        std::list<int64_t>::iterator lru;
+        bool pinned = false;
+    };
+
+    void pin(Entry &entry);
+    void evict();
+    void ageSeekCounts();
+
+    const int64_t _budget;
+    const int64_t _blockSize;
+
+    mutable std::mutex _mutex;
+    /** Offsets, most recently used first */
+    std::list<int64_t> _lru;
+    std::unordered_map<int64_t, Entry> _entries;
+    std::unordered_map<int64_t, uint32_t> _seekCounts;
+    Stats _stats;
+};
+
+#endif // MDKBLOCKCACHE_H
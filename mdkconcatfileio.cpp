@@ -0,0 +1,250 @@
+#include "mdkconcatfileio.h"
+#include "mdkpreloader.h"
+#include "mdktrace.h"
+#include <algorithm>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QUrl>
+#include <QtCore/QUrlQuery>
+
+MdkConcatFileIO::MdkConcatFileIO():
+    mdk::MediaIO()
+{
+    // empty
+}
+
+MdkConcatFileIO::~MdkConcatFileIO()
+{
+    finishOpenAhead();
+}
+
+void MdkConcatFileIO::registerOnce()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkConcatFileIO");
+    MediaIO::registerOnce(NAME, []{ return new MdkConcatFileIO();});
+}
+
+const char *MdkConcatFileIO::name() const
+{
+    return NAME;
+}
+
+const std::set<std::string> &MdkConcatFileIO::protocols() const {
+    static const std::set<std::string> s{PROTOCOL};
+    return s;
+}
+
+int64_t MdkConcatFileIO::read(uint8_t *data, int64_t maxSize)
+{
+    if (_segments.empty()) {
+        return 0;
+    }
+
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize && _position < _size) {
+        if (!enter(segmentAt(_position), _position)) {
+            return bytesRead > 0 ? bytesRead : -1;
+        }
+        Segment &segment = _segments[_current];
+        const int64_t segmentEnd = segment.offset + segment.size;
+        const int64_t length = qMin(maxSize - bytesRead, segmentEnd - _position);
+        const int64_t result = segment.io->read(data + bytesRead, length);
+        if (result < 0) {
+            return bytesRead > 0 ? bytesRead : -1;
+        }
+        if (result == 0) {
+            MDKIO_TRACE(MDK_NS::Warning, "%s ended before its size of %lld bytes",
+                        qPrintable(segment.fileName), static_cast<long long>(segment.size));
+            return bytesRead > 0 ? bytesRead : -1;
+        }
+        bytesRead += result;
+        _position += result;
+
+        // Open the next segment ahead of the boundary, it takes over what was preloaded
+        if (_current + 1 < _segments.size() && segmentEnd - _position <= OPEN_AHEAD &&
+                !_segments[_current + 1].io && !_opener.joinable()) {
+            openAhead(_current + 1);
+        }
+        // Let the demuxer handle what it has, rather than waiting for the next segment
+        if (result < length) {
+            break;
+        }
+    }
+    return bytesRead;
+}
+
+bool MdkConcatFileIO::seek(int64_t offset, int from)
+{
+    int64_t position = offset;
+    if (from == SEEK_CUR) {
+        position += _position;
+    } else if (from == SEEK_END) {
+        position += _size;
+    }
+    if (_segments.empty() || position < 0 || position > _size) {
+        return false;
+    }
+    if (!enter(segmentAt(position), position)) {
+        return false;
+    }
+    _position = position;
+    return true;
+}
+
+int64_t MdkConcatFileIO::position() const
+{
+    return _position;
+}
+
+int64_t MdkConcatFileIO::size() const
+{
+    return _size;
+}
+
+size_t MdkConcatFileIO::segmentAt(int64_t position) const
+{
+    const auto next = std::upper_bound(_segments.begin(), _segments.end(), position, [](int64_t value, const Segment &segment) {
+        return value < segment.offset;
+    });
+    return static_cast<size_t>(qMax<ptrdiff_t>(0, (next - _segments.begin()) - 1));
+}
+
+bool MdkConcatFileIO::enter(size_t index, int64_t position)
+{
+    if (index != _current) {
+        finishOpenAhead();
+        for (size_t i = 0; i < _segments.size(); ++i) {
+            if (i != index && i != index + 1) {
+                _segments[i].io.reset();
+            }
+        }
+        _current = index;
+    }
+
+    if (!open(index)) {
+        return false;
+    }
+    const Segment &segment = _segments[index];
+    const int64_t segmentPosition = position - segment.offset;
+    return segment.io->position() == segmentPosition || segment.io->seek(segmentPosition);
+}
+
+bool MdkConcatFileIO::open(size_t index)
+{
+    Segment &segment = _segments[index];
+    if (segment.io) {
+        return true;
+    }
+
+    segment.io = openSegment(segment.fileName, bufferSize());
+    if (!segment.io) {
+        return false;
+    }
+
+    // The segment after it is next
+    if (index + 1 < _segments.size() && !_segments[index + 1].io && _preloadBudget > 0) {
+        MdkPreloader::instance().preload(_segments[index + 1].fileName, _preloadBudget);
+    }
+    return true;
+}
+
+void MdkConcatFileIO::openAhead(size_t index)
+{
+    _opening = index;
+    const QString fileName = _segments[index].fileName;
+    const int64_t size = bufferSize();
+    _opener = std::thread([this, fileName, size]{
+        _opened = openSegment(fileName, size);
+    });
+
+    // Once it is opened the segment after it is next
+    if (index + 1 < _segments.size() && _preloadBudget > 0) {
+        MdkPreloader::instance().preload(_segments[index + 1].fileName, _preloadBudget);
+    }
+}
+
+void MdkConcatFileIO::finishOpenAhead()
+{
+    if (!_opener.joinable()) {
+        return;
+    }
+    MDKIO_TRACE_SPAN(span, "wait for segment");
+    _opener.join();
+    // If it failed enter() tries again
+    if (_opened && _opening < _segments.size()) {
+        _segments[_opening].io = std::move(_opened);
+    }
+    _opened.reset();
+}
+
+std::unique_ptr<MdkLocalFileIO> MdkConcatFileIO::openSegment(const QString &fileName, int64_t bufferSize) const
+{
+    MDKIO_TRACE_SPAN(span, "open segment");
+    QUrl url = QUrl::fromLocalFile(fileName);
+    url.setScheme(MdkLocalFileIO::PROTOCOL);
+    url.setQuery(_query);
+    auto io = std::make_unique<MdkLocalFileIO>();
+    io->setBufferSize(bufferSize);
+    if (!io->setUrl(url.toString().toStdString())) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to open segment %s", qPrintable(fileName));
+        return nullptr;
+    }
+    return io;
+}
+
+bool MdkConcatFileIO::onUrlChanged()
+{
+    finishOpenAhead();
+    _segments.clear();
+    _size = 0;
+    _position = 0;
+    _current = 0;
+
+    if (url().empty())
+        return true;
+
+    QUrl manifestUrl(QString::fromStdString(url()));
+    QUrlQuery query(manifestUrl);
+    const QString preloadOption = query.queryItemValue("preload");
+    _preloadBudget = (preloadOption.isEmpty() ? DEFAULT_PRELOAD_MB : preloadOption.toLongLong()) * 1024 * 1024;
+    query.removeAllQueryItems("preload");
+    _query = query.toString();
+    manifestUrl.setScheme("file");
+
+    const QString manifestName = manifestUrl.toLocalFile();
+    QFile manifest(manifestName);
+    if (!manifest.open(QFile::ReadOnly)) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to open manifest %s", qPrintable(manifestName));
+        return false;
+    }
+    const QDir directory = QFileInfo(manifestName).absoluteDir();
+    for (const QByteArray &line: manifest.readAll().split('\n')) {
+        const QString name = QString::fromUtf8(line.trimmed());
+        if (name.isEmpty() || name.startsWith('#')) {
+            continue;
+        }
+        Segment segment;
+        segment.fileName = directory.filePath(name);
+        const QFileInfo info(segment.fileName);
+        if (!info.isFile()) {
+            MDKIO_TRACE(MDK_NS::Warning, "Missing segment %s in %s", qPrintable(segment.fileName), qPrintable(manifestName));
+            _segments.clear();
+            return false;
+        }
+        segment.offset = _size;
+        segment.size = info.size();
+        if (segment.size > 0) {
+            _size += segment.size;
+            _segments.push_back(std::move(segment));
+        }
+    }
+    if (_segments.empty()) {
+        MDKIO_TRACE(MDK_NS::Warning, "No segments in %s", qPrintable(manifestName));
+        return false;
+    }
+
+    MDKIO_TRACE(MDK_NS::Info, "Concatenating %d segments of %s, %lld bytes",
+                static_cast<int>(_segments.size()), qPrintable(manifestName), static_cast<long long>(_size));
+    return enter(0, 0);
+}
@@ -0,0 +1,109 @@
+#ifndef MDKCONCATFILEIO_H
+#define MDKCONCATFILEIO_H
+
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include <QtCore/QString>
+
+#include "mdklocalfileio.h"
+
+/**
+ * MediaIO presenting the segments of a route as one file, for urls like
+ * concatfile:///routes/alpe.txt?io=readahead
+ *
+ * The url points to a manifest listing the segment files, one per line,
+ * relative to the manifest or absolute; empty lines and lines starting
+ * with '#' are skipped. The segments are read one after the other through
+ * an MdkLocalFileIO each, which gets the query items of the url, so a
+ * format that concatenates cleanly such as MPEG-TS plays as a single
+ * media without opening and probing it again at every boundary.
+ *
+ * When a segment is opened the next one is preloaded with "preload=<MB>",
+ * see MdkPreloader. Once reading gets within OPEN_AHEAD bytes of the
+ * boundary the next segment is opened on a background thread, which also
+ * waits for its preload, and it is handed over when reading crosses the
+ * boundary, so the demux thread doesn't wait for the disk. Opening it
+ * ahead preloads the one after it in turn. Only the current and next
+ * segment are kept open.
+ */
+class MdkConcatFileIO: public MDK_NS::MediaIO
+{
+public:
+    static constexpr char const * NAME = "MdkConcatFileIO";
+    static constexpr char const * PROTOCOL = "concatfile";
+
+    /** Default budget in MB for preloading the next segment, see "preload" */
+    static constexpr int64_t DEFAULT_PRELOAD_MB = 32;
+    /** Distance from the end of a segment at which the next one is opened */
+    static constexpr int64_t OPEN_AHEAD = 8 * 1024 * 1024;
+
+    MdkConcatFileIO();
+
+    ~MdkConcatFileIO() override;
+
+    static void registerOnce();
+
+    const char* name() const override;
+
+    const std::set<std::string> &protocols() const override;
+
+    /** Always seekable! */
+    bool isSeekable() const override { return true; }
+    /** We don't need or want any writing done */
+    bool isWritable() const override { return false; }
+
+    /** Read from the segment at the position, continuing into the next one */
+    int64_t read(uint8_t *data, int64_t maxSize) override;
+
+    /** No writing is possible */
+    int64_t write(const uint8_t *, int64_t) override { return 0; }
+
+    /** Seek in the concatenation of the segments */
+    bool seek(int64_t offset, int from = SEEK_SET) override;
+
+    /** Get the current position */
+    int64_t position() const override;
+
+    /** Get the total size of the segments */
+    int64_t size() const override;
+
+protected:
+    bool onUrlChanged() override;
+private:
+    struct Segment {
+        QString fileName;
+        /** Position of the first byte of the segment in the concatenation */
+        int64_t offset = 0;
+        int64_t size = 0;
+        std::unique_ptr<MdkLocalFileIO> io;
+    };
+
+    /** Index of the segment holding position, the last one at the end */
+    size_t segmentAt(int64_t position) const;
+    /** Make index the current segment, opened and at position */
+    bool enter(size_t index, int64_t position);
+    /** Open the segment at index if it isn't, preloading the one after it */
+    bool open(size_t index);
+    /** Open the segment at index on a background thread, see finishOpenAhead() */
+    void openAhead(size_t index);
+    /** Wait for the segment being opened ahead, if any, and hand it to its segment */
+    void finishOpenAhead();
+    std::unique_ptr<MdkLocalFileIO> openSegment(const QString &fileName, int64_t bufferSize) const;
+
+    std::vector<Segment> _segments;
+    /** Query items passed on to the segments */
+    QString _query;
+    int64_t _preloadBudget = 0;
+    int64_t _size = 0;
+    int64_t _position = 0;
+    size_t _current = 0;
+
+    std::thread _opener;
+    /** Segment being opened by _opener, and its io once opened */
+    size_t _opening = 0;
+    std::unique_ptr<MdkLocalFileIO> _opened;
+};
+
+#endif // MDKCONCATFILEIO_H
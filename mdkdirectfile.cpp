@@ -0,0 +1,150 @@
+#include "mdkdirectfile.h"
+#include <cerrno>
+#include <cstring>
+#include <QtCore/QFile>
+
+#if defined Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MdkDirectFile::~MdkDirectFile()
+{
+    close();
+}
+
+bool MdkDirectFile::open(const QString &fileName)
+{
+    close();
+    _fileName = fileName;
+
+    _buffer = MdkAlignedBufferPool::instance().acquire();
+    if (!_buffer) {
+        return false;
+    }
+
+#if defined Q_OS_LINUX
+    _fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+    if (_fd >= 0) {
+        _direct = true;
+        return true;
+    }
+    // EINVAL means the filesystem does not support O_DIRECT
+    return (errno == EINVAL) && reopenBuffered();
+#elif defined Q_OS_MAC
+    _fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        return false;
+    }
+    fcntl(_fd, F_NOCACHE, 1);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MdkDirectFile::close()
+{
+#if defined Q_OS_UNIX
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+#endif
+    _fd = -1;
+    _direct = false;
+    _buffer.reset();
+    _bufferOffset = 0;
+    _bufferLength = 0;
+}
+
+int64_t MdkDirectFile::read(int64_t position, uint8_t *data, int64_t maxSize)
+{
+    if (_fd < 0 || position < 0) {
+        return -1;
+    }
+
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize) {
+        if (position < _bufferOffset || position >= _bufferOffset + _bufferLength) {
+            if (!fill(position)) {
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+        }
+        const int64_t available = _bufferOffset + _bufferLength - position;
+        if (available <= 0) {
+            // End of file
+            break;
+        }
+        const int64_t chunk = qMin(available, maxSize - bytesRead);
+        std::memcpy(data + bytesRead, _buffer.get() + (position - _bufferOffset), static_cast<size_t>(chunk));
+        bytesRead += chunk;
+        position += chunk;
+    }
+    return bytesRead;
+}
+
+bool MdkDirectFile::fill(int64_t position)
+{
+    const int64_t alignedOffset = position - position % MdkAlignedBufferPool::ALIGNMENT;
+    const int64_t length = readAt(alignedOffset, _buffer.get(), MdkAlignedBufferPool::BUFFER_SIZE);
+    if (length < 0) {
+        return false;
+    }
+    _bufferOffset = alignedOffset;
+    _bufferLength = length;
+
+    if (!_direct) {
+        // The data now lives in our buffer, so the page cache does not need it
+        dropCache(alignedOffset, length);
+    }
+    return true;
+}
+
+int64_t MdkDirectFile::readAt(int64_t offset, uint8_t *data, int64_t size)
+{
+#if defined Q_OS_UNIX
+    for (;;) {
+        const ssize_t length = ::pread(_fd, data, static_cast<size_t>(size), static_cast<off_t>(offset));
+        if (length >= 0) {
+            return length;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        // Some filesystems accept O_DIRECT on open, but reject the reads
+        if (errno == EINVAL && _direct && reopenBuffered()) {
+            continue;
+        }
+        return -1;
+    }
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+    return -1;
+#endif
+}
+
+bool MdkDirectFile::reopenBuffered()
+{
+#if defined Q_OS_UNIX
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+    _direct = false;
+    _fd = ::open(QFile::encodeName(_fileName).constData(), O_RDONLY | O_CLOEXEC);
+    return _fd >= 0;
+#else
+    return false;
+#endif
+}
+
+void MdkDirectFile::dropCache(int64_t offset, int64_t length)
+{
+#if defined Q_OS_LINUX
+    posix_fadvise(_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
@@ -0,0 +1,57 @@
+#ifndef MDKDIRECTFILE_H
+#define MDKDIRECTFILE_H
+
+#include <cstdint>
+#include <QtCore/QString>
+
+#include "mdkalignedbufferpool.h"
+
+/**
+ * Reads a file without filling the page cache.
+ *
+ * On Linux the file is opened with O_DIRECT and read in aligned blocks into
+ * a buffer from MdkAlignedBufferPool, from which unaligned reads are served.
+ * Filesystems that reject O_DIRECT are read normally, and every consumed
+ * block is dropped from the page cache with posix_fadvise(DONTNEED). On
+ * macOS caching is disabled with F_NOCACHE, which has no alignment
+ * requirements.
+ */
+class MdkDirectFile
+{
+public:
+    MdkDirectFile() = default;
+    ~MdkDirectFile();
+
+    MdkDirectFile(const MdkDirectFile &) = delete;
+    MdkDirectFile &operator=(const MdkDirectFile &) = delete;
+
+    /** Open fileName. Returns false if it cannot be opened or uncached reads are not supported. */
+    bool open(const QString &fileName);
+    void close();
+
+    /** True if O_DIRECT is in use, false when falling back to dropping the page cache */
+    bool isDirect() const { return _direct; }
+
+    /**
+     * Read at most maxSize bytes at position.
+     * \return bytes read, 0 at the end of the file, -1 on a read error.
+     */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize);
+
+private:
+    bool fill(int64_t position);
+    int64_t readAt(int64_t offset, uint8_t *data, int64_t size);
+    bool reopenBuffered();
+    void dropCache(int64_t offset, int64_t length);
+
+    QString _fileName;
+    int _fd = -1;
+    bool _direct = false;
+
+    MdkAlignedBufferPool::Buffer _buffer;
+    /** File offset and length of the data in _buffer */
+    int64_t _bufferOffset = 0;
+    int64_t _bufferLength = 0;
+};
+
+#endif // MDKDIRECTFILE_H
@@ -0,0 +1,414 @@
+#include "mdkdiskcache.h"
+#include "mdkendian.h"
+#include "mdktrace.h"
+#include <cerrno>
+#include <cstring>
+#include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+#if defined Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::mutex registryMutex;
+std::map<QString, std::weak_ptr<MdkDiskCache>> registry;
+
+/** Bitmap file layout: magic, source size, source modification time in ms, unit size and time last used, 8 bytes each, then the bitmap */
+const char MAGIC[8] = {'M', 'D', 'K', 'D', 'C', 'M', 'A', '1'};
+constexpr int HEADER_SIZE = 40;
+
+struct Header {
+    int64_t size = -1;
+    int64_t modified = 0;
+    int64_t lastUsed = 0;
+    /** Units present */
+    int64_t present = 0;
+    std::vector<uint8_t> bitmap;
+};
+
+/** Read a bitmap file, returning a header with size -1 if it is missing or invalid */
+Header readHeader(const QString &path)
+{
+    Header header;
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly)) {
+        return header;
+    }
+    const QByteArray data = file.readAll();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.constData());
+    if (data.size() < HEADER_SIZE || std::memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0 ||
+            static_cast<int64_t>(littleEndian64(bytes + 24)) != MdkDiskCache::UNIT_SIZE) {
+        return header;
+    }
+    const int64_t size = static_cast<int64_t>(littleEndian64(bytes + 8));
+    const int64_t units = (size + MdkDiskCache::UNIT_SIZE - 1) / MdkDiskCache::UNIT_SIZE;
+    if (size < 0 || data.size() != HEADER_SIZE + (units + 7) / 8) {
+        return header;
+    }
+    header.size = size;
+    header.modified = static_cast<int64_t>(littleEndian64(bytes + 16));
+    header.lastUsed = static_cast<int64_t>(littleEndian64(bytes + 32));
+    header.bitmap.assign(bytes + HEADER_SIZE, bytes + data.size());
+    for (int64_t unit = 0; unit < units; ++unit) {
+        if (header.bitmap[static_cast<size_t>(unit / 8)] & (1 << (unit % 8))) {
+            ++header.present;
+        }
+    }
+    return header;
+}
+
+}
+
+MdkDiskCache::MdkDiskCache(const QString &directory, int64_t budget):
+    _directory(directory),
+    _budget(budget)
+{
+    // empty
+}
+
+std::shared_ptr<MdkDiskCache> MdkDiskCache::open(const QString &directory, int64_t budget)
+{
+#if defined Q_OS_UNIX
+    if (!QDir().mkpath(directory)) {
+        return nullptr;
+    }
+    const QString path = QFileInfo(directory).canonicalFilePath();
+    if (path.isEmpty()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto found = registry.find(path);
+    if (found != registry.end()) {
+        if (std::shared_ptr<MdkDiskCache> cache = found->second.lock()) {
+            return cache;
+        }
+    }
+    std::shared_ptr<MdkDiskCache> cache(new MdkDiskCache(path, budget));
+    cache->scan();
+    registry[path] = cache;
+    return cache;
+#else
+    Q_UNUSED(directory)
+    Q_UNUSED(budget)
+    return nullptr;
+#endif
+}
+
+void MdkDiskCache::scan()
+{
+    const QDir directory(_directory);
+    for (const QString &name: directory.entryList(QStringList() << "*.map", QDir::Files)) {
+        const QString key = name.left(name.size() - 4);
+        const Header header = readHeader(directory.filePath(name));
+        Entry &entry = _entries[key];
+        entry.bytes = (header.size >= 0) ? header.present * UNIT_SIZE : 0;
+        entry.lastUsed = header.lastUsed;
+        _used += entry.bytes;
+    }
+    // Copies whose bitmap was never written hold nothing that can be used
+    for (const QString &name: directory.entryList(QStringList() << "*.data", QDir::Files)) {
+        if (_entries.find(name.left(name.size() - 5)) == _entries.end()) {
+            QFile::remove(directory.filePath(name));
+        }
+    }
+    MDKIO_TRACE(MDK_NS::Debug, "Disk cache %s holds %lld bytes in %d files",
+                qPrintable(_directory), static_cast<long long>(_used), static_cast<int>(_entries.size()));
+}
+
+QString MdkDiskCache::pathOf(const QString &key, const char *suffix) const
+{
+    return QDir(_directory).filePath(key + suffix);
+}
+
+std::shared_ptr<MdkDiskCache::File> MdkDiskCache::file(const QString &fileName)
+{
+#if defined Q_OS_UNIX
+    const QFileInfo info(fileName);
+    const QString canonicalPath = info.canonicalFilePath();
+    if (canonicalPath.isEmpty()) {
+        return nullptr;
+    }
+    return file(canonicalPath, info.size(), info.lastModified().toMSecsSinceEpoch());
+#else
+    Q_UNUSED(fileName)
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<MdkDiskCache::File> MdkDiskCache::file(const QString &source, int64_t size, int64_t modified)
+{
+#if defined Q_OS_UNIX
+    const QString key = QString::fromLatin1(QCryptographicHash::hash(source.toUtf8(), QCryptographicHash::Sha1).toHex());
+
+    // Declared before the lock, as the copy is closed if its last reader has gone meanwhile
+    std::shared_ptr<File> existing;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_entries[key].open) {
+        existing = _entries[key].file.lock();
+        if (existing) {
+            // A source changed while its copy is in use isn't cached
+            return (existing->_size == size && existing->_modified == modified) ? existing : nullptr;
+        }
+        // The last reader has gone and the copy is saving its bitmap
+        _closedCondition.wait(lock);
+    }
+    Entry &entry = _entries[key];
+
+    const int fd = ::open(QFile::encodeName(pathOf(key, ".data")).constData(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    Header header = readHeader(pathOf(key, ".map"));
+    const bool valid = (header.size == size && header.modified == modified);
+    if (!valid) {
+        // New, or the source has changed: start from an empty sparse file
+        if (header.size >= 0) {
+            MDKIO_TRACE(MDK_NS::Debug, "Disk cache copy of %s is stale", qPrintable(source));
+        }
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+    }
+
+    std::shared_ptr<File> file(new File(shared_from_this(), key, fd, size, modified));
+    if (valid) {
+        file->_bitmap = std::move(header.bitmap);
+        file->_present = header.present;
+    }
+    _used += file->_present * UNIT_SIZE - entry.bytes;
+    entry.bytes = file->_present * UNIT_SIZE;
+    entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+    entry.file = file;
+    entry.open = true;
+    return file;
+#else
+    Q_UNUSED(source)
+    Q_UNUSED(size)
+    Q_UNUSED(modified)
+    return nullptr;
+#endif
+}
+
+int64_t MdkDiskCache::usedBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _used;
+}
+
+bool MdkDiskCache::reserve(const QString &key, int64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    while (_used + bytes > _budget) {
+        // Evict the least recently used copy not in use
+        auto oldest = _entries.end();
+        for (auto entry = _entries.begin(); entry != _entries.end(); ++entry) {
+            if (entry->first != key && !entry->second.open &&
+                    (oldest == _entries.end() || entry->second.lastUsed < oldest->second.lastUsed)) {
+                oldest = entry;
+            }
+        }
+        if (oldest == _entries.end()) {
+            return false;
+        }
+        QFile::remove(pathOf(oldest->first, ".map"));
+        QFile::remove(pathOf(oldest->first, ".data"));
+        _used -= oldest->second.bytes;
+        _entries.erase(oldest);
+    }
+    _used += bytes;
+    _entries[key].bytes += bytes;
+    return true;
+}
+
+void MdkDiskCache::release(const QString &key, int64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _used -= bytes;
+    _entries[key].bytes -= bytes;
+}
+
+void MdkDiskCache::closed(const QString &key)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Entry &entry = _entries[key];
+        entry.lastUsed = QDateTime::currentMSecsSinceEpoch();
+        entry.open = false;
+    }
+    _closedCondition.notify_all();
+}
+
+MdkDiskCache::File::File(std::shared_ptr<MdkDiskCache> cache, const QString &key, int fd, int64_t size, int64_t modified):
+    _cache(std::move(cache)),
+    _key(key),
+    _fd(fd),
+    _size(size),
+    _modified(modified),
+    _bitmap(static_cast<size_t>(((size + UNIT_SIZE - 1) / UNIT_SIZE + 7) / 8)),
+    _units((size + UNIT_SIZE - 1) / UNIT_SIZE)
+{
+    // empty
+}
+
+MdkDiskCache::File::~File()
+{
+    save();
+#if defined Q_OS_UNIX
+    ::close(_fd);
+#endif
+    _cache->closed(_key);
+}
+
+bool MdkDiskCache::File::isPresent(int64_t first, int64_t last) const
+{
+    for (int64_t unit = first; unit < last; ++unit) {
+        if (!(_bitmap[static_cast<size_t>(unit / 8)] & (1 << (unit % 8)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MdkDiskCache::File::read(int64_t offset, uint8_t *data, int64_t length)
+{
+#if defined Q_OS_UNIX
+    if (offset < 0 || length <= 0 || length > _size - offset) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!isPresent(offset / UNIT_SIZE, (offset + length - 1) / UNIT_SIZE + 1)) {
+            return false;
+        }
+    }
+
+    int64_t bytesRead = 0;
+    while (bytesRead < length) {
+        const ssize_t result = ::pread(_fd, data + bytesRead, static_cast<size_t>(length - bytesRead),
+                                       static_cast<off_t>(offset + bytesRead));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        bytesRead += result;
+    }
+    return true;
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(data)
+    Q_UNUSED(length)
+    return false;
+#endif
+}
+
+void MdkDiskCache::File::write(int64_t offset, const uint8_t *data, int64_t length)
+{
+#if defined Q_OS_UNIX
+    const int64_t end = offset + length;
+    if (offset < 0 || length <= 0 || end > _size) {
+        return;
+    }
+    const int64_t first = (offset + UNIT_SIZE - 1) / UNIT_SIZE;
+    const int64_t last = (end == _size) ? _units : end / UNIT_SIZE;
+    if (first >= last) {
+        return;
+    }
+
+    int64_t missing = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int64_t unit = first; unit < last; ++unit) {
+            if (!(_bitmap[static_cast<size_t>(unit / 8)] & (1 << (unit % 8)))) {
+                ++missing;
+            }
+        }
+    }
+    if (missing == 0 || !_cache->reserve(_key, missing * UNIT_SIZE)) {
+        return;
+    }
+
+    // Present units are written again, they hold the same data
+    const int64_t start = first * UNIT_SIZE;
+    const int64_t stop = qMin(last * UNIT_SIZE, _size);
+    int64_t written = 0;
+    while (written < stop - start) {
+        const ssize_t result = ::pwrite(_fd, data + (start - offset) + written, static_cast<size_t>(stop - start - written),
+                                        static_cast<off_t>(start + written));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            _cache->release(_key, missing * UNIT_SIZE);
+            return;
+        }
+        written += result;
+    }
+
+    // Another thread may have stored some of the same units meanwhile
+    int64_t added = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int64_t unit = first; unit < last; ++unit) {
+            uint8_t &byte = _bitmap[static_cast<size_t>(unit / 8)];
+            if (!(byte & (1 << (unit % 8)))) {
+                byte = static_cast<uint8_t>(byte | (1 << (unit % 8)));
+                ++added;
+            }
+        }
+        _present += added;
+        _dirty = _dirty || added > 0;
+    }
+    if (added < missing) {
+        _cache->release(_key, (missing - added) * UNIT_SIZE);
+    }
+#else
+    Q_UNUSED(offset)
+    Q_UNUSED(data)
+    Q_UNUSED(length)
+#endif
+}
+
+int64_t MdkDiskCache::File::cachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return qMin(_present * UNIT_SIZE, _size);
+}
+
+void MdkDiskCache::File::save()
+{
+#if defined Q_OS_UNIX
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_dirty) {
+        return;
+    }
+    // The bitmap must not claim data that isn't on disk yet
+    fdatasync(_fd);
+
+    QByteArray data(MAGIC, sizeof(MAGIC));
+    appendLittleEndian64(data, static_cast<uint64_t>(_size));
+    appendLittleEndian64(data, static_cast<uint64_t>(_modified));
+    appendLittleEndian64(data, static_cast<uint64_t>(UNIT_SIZE));
+    appendLittleEndian64(data, static_cast<uint64_t>(QDateTime::currentMSecsSinceEpoch()));
+    data.append(reinterpret_cast<const char*>(_bitmap.data()), static_cast<int>(_bitmap.size()));
+
+    QSaveFile file(_cache->pathOf(_key, ".map"));
+    if (!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to save disk cache bitmap %s", qPrintable(file.fileName()));
+        return;
+    }
+    _dirty = false;
+#endif
+}
@@ -0,0 +1,128 @@
+#ifndef MDKDISKCACHE_H
+#define MDKDISKCACHE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <QtCore/QString>
+
+/**
+ * Read-through copy of slow media, such as files on a network mount or a
+ * spinning disk, in a size-bounded directory on a fast local drive.
+ *
+ * Every source file gets a sparse file of the same size in the directory,
+ * named after a hash of its canonical path or url, into which the data
+ * read from the source is written at the same offsets. A bitmap of the
+ * UNIT_SIZE units present is kept next to it, together with the size and
+ * modification time of the source; a copy of a source that has changed
+ * since is emptied. Later reads of those units come from the local copy.
+ *
+ * When the directory would exceed its budget, the least recently used
+ * copies that are not open, or still saving their bitmap after their last
+ * reader has gone, are deleted. If that isn't enough, new data is
+ * not copied.
+ *
+ * Only available on Unix, open() returns nullptr elsewhere.
+ */
+class MdkDiskCache : public std::enable_shared_from_this<MdkDiskCache>
+{
+public:
+    /** Granularity at which data is copied and tracked */
+    static constexpr int64_t UNIT_SIZE = 64 * 1024;
+
+    /** The local copy of one source file, shared by all its readers */
+    class File
+    {
+    public:
+        /** Saves the bitmap */
+        ~File();
+
+        File(const File &) = delete;
+        File &operator=(const File &) = delete;
+
+        /** Copy length bytes at offset into data if they are all present. Safe to call from any thread. */
+        bool read(int64_t offset, uint8_t *data, int64_t length);
+
+        /**
+         * Store length bytes read from the source at offset. Only the units
+         * covered completely, or up to the end of the file, are kept. Safe
+         * to call from any thread.
+         */
+        void write(int64_t offset, const uint8_t *data, int64_t length);
+
+        /** Bytes present in the copy */
+        int64_t cachedBytes() const;
+
+    private:
+        friend class MdkDiskCache;
+
+        File(std::shared_ptr<MdkDiskCache> cache, const QString &key, int fd, int64_t size, int64_t modified);
+        bool isPresent(int64_t first, int64_t last) const;
+        void save();
+
+        const std::shared_ptr<MdkDiskCache> _cache;
+        const QString _key;
+        const int _fd;
+        const int64_t _size;
+        const int64_t _modified;
+
+        mutable std::mutex _mutex;
+        std::vector<uint8_t> _bitmap;
+        int64_t _units = 0;
+        /** Number of units set in the bitmap */
+        int64_t _present = 0;
+        bool _dirty = false;
+    };
+
+    /**
+     * The cache in directory, shared by all its users. Created by the first
+     * caller with the given budget in bytes; later callers get the same
+     * cache whatever budget they ask for. nullptr if the directory can't
+     * be created.
+     */
+    static std::shared_ptr<MdkDiskCache> open(const QString &directory, int64_t budget);
+
+    /** The local copy of fileName, opened or created. nullptr on failure. */
+    std::shared_ptr<File> file(const QString &fileName);
+
+    /**
+     * The local copy of a source that isn't a local file, such as a url,
+     * identified by the source string, its size and modification time.
+     */
+    std::shared_ptr<File> file(const QString &source, int64_t size, int64_t modified);
+
+    /** Bytes held by all copies in the directory */
+    int64_t usedBytes() const;
+
+private:
+    struct Entry {
+        int64_t bytes = 0;
+        /** ms since the epoch */
+        int64_t lastUsed = 0;
+        std::weak_ptr<File> file;
+        /** From file() until closed(), which runs after file has expired */
+        bool open = false;
+    };
+
+    MdkDiskCache(const QString &directory, int64_t budget);
+    void scan();
+    QString pathOf(const QString &key, const char *suffix) const;
+    /** Account for bytes added to the copy key, evicting others if needed. False if there is no room. */
+    bool reserve(const QString &key, int64_t bytes);
+    void release(const QString &key, int64_t bytes);
+    void closed(const QString &key);
+
+    const QString _directory;
+    const int64_t _budget;
+
+    mutable std::mutex _mutex;
+    std::map<QString, Entry> _entries;
+    int64_t _used = 0;
+    /** Signalled by closed() */
+    std::condition_variable _closedCondition;
+};
+
+#endif // MDKDISKCACHE_H
@@ -0,0 +1,28 @@
+#ifndef MDKENDIAN_H
+#define MDKENDIAN_H
+
+#include <cstdint>
+#include <QtCore/QByteArray>
+
+/**
+ * Helpers for the 8 byte little-endian fields of the files kept next to
+ * the media, the MdkSeekIndex sidecars and the MdkDiskCache bitmaps.
+ */
+
+inline uint64_t littleEndian64(const uint8_t *data)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+inline void appendLittleEndian64(QByteArray &data, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        data.append(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+#endif // MDKENDIAN_H
@@ -0,0 +1,69 @@
+#include "mdkfilemapping.h"
+
+MdkFileMapping::MdkFileMapping(QFile &file):
+    _file(file)
+{
+    // empty
+}
+
+MdkFileMapping::~MdkFileMapping()
+{
+    unmap();
+}
+
+bool MdkFileMapping::map()
+{
+    unmap();
+
+    _fileSize = _file.size();
+    if (_fileSize <= 0) {
+        return false;
+    }
+    _windowSize = (sizeof(void*) < 8) ? WINDOW_SIZE_32BIT : _fileSize;
+
+    return mapWindow(0);
+}
+
+void MdkFileMapping::unmap()
+{
+    if (_window != nullptr) {
+        _file.unmap(_window);
+        _window = nullptr;
+    }
+    _windowOffset = 0;
+    _windowLength = 0;
+}
+
+const uint8_t *MdkFileMapping::data(int64_t offset, int64_t &available)
+{
+    available = 0;
+    if (offset < 0 || offset >= _fileSize) {
+        return nullptr;
+    }
+
+    if (_window == nullptr || offset < _windowOffset || offset >= _windowOffset + _windowLength) {
+        if (!mapWindow(offset)) {
+            return nullptr;
+        }
+    }
+
+    const int64_t windowPosition = offset - _windowOffset;
+    available = _windowLength - windowPosition;
+    return _window + windowPosition;
+}
+
+bool MdkFileMapping::mapWindow(int64_t offset)
+{
+    unmap();
+
+    const int64_t windowOffset = offset - offset % WINDOW_ALIGNMENT;
+    const int64_t windowLength = qMin(_windowSize, _fileSize - windowOffset);
+
+    _window = _file.map(windowOffset, windowLength);
+    if (_window == nullptr) {
+        return false;
+    }
+    _windowOffset = windowOffset;
+    _windowLength = windowLength;
+    return true;
+}
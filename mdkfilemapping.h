@@ -0,0 +1,53 @@
+#ifndef MDKFILEMAPPING_H
+#define MDKFILEMAPPING_H
+
+#include <cstdint>
+#include <QtCore/QFile>
+
+/**
+ * Maps an open QFile into memory, either completely or as a sliding window.
+ *
+ * On 64-bit builds the whole file is mapped at once. On 32-bit builds the
+ * address space is too small for 4K videos of several GB, so only a window
+ * of WINDOW_SIZE_32BIT bytes is mapped and moved along when data outside of
+ * it is requested.
+ */
+class MdkFileMapping
+{
+public:
+    /** Size of the window on 32-bit builds */
+    static constexpr int64_t WINDOW_SIZE_32BIT = 256 * 1024 * 1024;
+    /** Window offsets are aligned to this, which is the allocation granularity on Windows */
+    static constexpr int64_t WINDOW_ALIGNMENT = 64 * 1024;
+
+    explicit MdkFileMapping(QFile &file);
+    ~MdkFileMapping();
+
+    MdkFileMapping(const MdkFileMapping &) = delete;
+    MdkFileMapping &operator=(const MdkFileMapping &) = delete;
+
+    /** Map the first window. Returns false if the file cannot be mapped. */
+    bool map();
+
+    /** Release the current window */
+    void unmap();
+
+    /**
+     * Get a pointer to the mapped data at offset. available is set to the
+     * number of bytes that can be read from the returned pointer. Returns
+     * nullptr at the end of the file or if mapping fails.
+     */
+    const uint8_t *data(int64_t offset, int64_t &available);
+
+private:
+    bool mapWindow(int64_t offset);
+
+    QFile &_file;
+    int64_t _fileSize = 0;
+    int64_t _windowSize = 0;
+    uchar *_window = nullptr;
+    int64_t _windowOffset = 0;
+    int64_t _windowLength = 0;
+};
+
+#endif // MDKFILEMAPPING_H
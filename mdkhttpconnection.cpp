@@ -0,0 +1,308 @@
+#include "mdkhttpconnection.h"
+#include "mdktrace.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QElapsedTimer>
+#include <QtNetwork/QTcpSocket>
+
+namespace {
+
+/** Time to wait for a connection, which can't be interrupted */
+constexpr int CONNECT_TIMEOUT_MS = 3000;
+
+/** Parse a Content-Range of "bytes <first>-<last>/<size>", the range being "*" on a 416 */
+void parseContentRange(const QByteArray &value, MdkHttpConnection::Response &response)
+{
+    if (!value.startsWith("bytes ")) {
+        return;
+    }
+    const QByteArray range = value.mid(6);
+    const int slash = range.indexOf('/');
+    if (slash < 0) {
+        return;
+    }
+    bool ok = false;
+    const int64_t totalSize = range.mid(slash + 1).toLongLong(&ok);
+    if (ok) {
+        response.totalSize = totalSize;
+    }
+    const int dash = range.indexOf('-');
+    if (dash > 0 && dash < slash) {
+        const int64_t first = range.left(dash).toLongLong(&ok);
+        if (ok) {
+            response.rangeStart = first;
+        }
+    }
+}
+
+/**
+ * Parse a Last-Modified date. Servers send the IMF-fixdate of HTTP, such as
+ * "Sat, 17 Oct 2026 18:11:54 GMT", which Qt::RFC2822Date only takes with a
+ * numeric zone. Returns an invalid QDateTime if it can't be parsed.
+ */
+QDateTime parseHttpDate(QByteArray value)
+{
+    if (value.endsWith(" GMT")) {
+        value.chop(3);
+        value += "+0000";
+    }
+    return QDateTime::fromString(QString::fromLatin1(value), Qt::RFC2822Date);
+}
+
+}
+
+MdkHttpConnection::MdkHttpConnection(const QString &host, quint16 port):
+    _host(host),
+    _port(port)
+{
+    // empty
+}
+
+MdkHttpConnection::~MdkHttpConnection()
+{
+    close();
+}
+
+bool MdkHttpConnection::request(const QByteArray &target, int64_t offset, int64_t length, Response &response,
+                                const Interrupted &interrupted)
+{
+    if (_remaining > 0) {
+        // The rest of the previous body is in the way
+        close();
+    }
+
+    QByteArray host = _host.toUtf8();
+    if (host.contains(':')) {
+        host = '[' + host + ']';
+    }
+    if (_port != 80) {
+        host += ':' + QByteArray::number(_port);
+    }
+    const QByteArray request = "GET " + target + " HTTP/1.1\r\n"
+            "Host: " + host + "\r\n"
+            "Range: bytes=" + QByteArray::number(static_cast<qint64>(offset)) + '-' +
+            QByteArray::number(static_cast<qint64>(offset + length - 1)) + "\r\n"
+            "Accept-Encoding: identity\r\n"
+            "User-Agent: mdkio\r\n"
+            "\r\n";
+
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        const bool reused = _socket && _used;
+        if (!_socket && !connect(interrupted)) {
+            return false;
+        }
+        if (send(request, interrupted) && readHeaders(response, interrupted)) {
+            return true;
+        }
+        // Servers close idle connections, which only shows when a request on one gets no response
+        const bool closed = _socket->state() != QAbstractSocket::ConnectedState;
+        close();
+        if (!reused || !closed) {
+            return false;
+        }
+        MDKIO_TRACE(MDK_NS::Debug, "Connection to %s was closed while idle, reconnecting", qPrintable(_host));
+    }
+    return false;
+}
+
+int64_t MdkHttpConnection::read(uint8_t *data, int64_t maxSize, const Interrupted &interrupted)
+{
+    if (_remaining == 0) {
+        return 0;
+    }
+    while (_socket->bytesAvailable() == 0) {
+        if (!waitForData(interrupted)) {
+            return -1;
+        }
+    }
+
+    const int64_t bytesRead = _socket->read(reinterpret_cast<char*>(data), qMin(maxSize, _remaining));
+    if (bytesRead < 0) {
+        fail(_socket->errorString());
+        return -1;
+    }
+    _remaining -= bytesRead;
+    if (_remaining == 0 && !_keepAlive) {
+        close();
+    }
+    return bytesRead;
+}
+
+bool MdkHttpConnection::discard(const Interrupted &interrupted)
+{
+    char buffer[16 * 1024];
+    while (_remaining > 0) {
+        if (read(reinterpret_cast<uint8_t*>(buffer), sizeof(buffer), interrupted) <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MdkHttpConnection::close()
+{
+    if (_socket) {
+        _socket->abort();
+        _socket.reset();
+    }
+    _used = false;
+    _keepAlive = true;
+    _remaining = 0;
+}
+
+bool MdkHttpConnection::connect(const Interrupted &interrupted)
+{
+    if (interrupted(0)) {
+        return fail("Interrupted");
+    }
+
+    _socket = std::make_unique<QTcpSocket>();
+    // Requests are small and answered before the next one is sent
+    _socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    _socket->connectToHost(_host, _port);
+
+    QElapsedTimer timer;
+    timer.start();
+    while (!_socket->waitForConnected(static_cast<int>(WAIT_INTERVAL_MS))) {
+        const QAbstractSocket::SocketState state = _socket->state();
+        if (state != QAbstractSocket::HostLookupState && state != QAbstractSocket::ConnectingState) {
+            fail(_socket->errorString());
+        } else if (timer.elapsed() >= CONNECT_TIMEOUT_MS) {
+            fail("Connection timed out");
+        } else if (interrupted(timer.elapsed())) {
+            fail("Interrupted");
+        } else {
+            continue;
+        }
+        _socket.reset();
+        return false;
+    }
+    return true;
+}
+
+bool MdkHttpConnection::send(const QByteArray &request, const Interrupted &interrupted)
+{
+    if (_socket->write(request) != request.size()) {
+        return fail(_socket->errorString());
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    while (_socket->bytesToWrite() > 0) {
+        if (!_socket->waitForBytesWritten(WAIT_INTERVAL_MS)) {
+            if (_socket->state() != QAbstractSocket::ConnectedState) {
+                return fail(_socket->errorString());
+            }
+            if (interrupted(timer.elapsed())) {
+                return fail("Interrupted");
+            }
+        }
+    }
+    return true;
+}
+
+bool MdkHttpConnection::readLine(QByteArray &line, const Interrupted &interrupted)
+{
+    while (!_socket->canReadLine()) {
+        if (_socket->bytesAvailable() > MAX_HEADER_SIZE) {
+            return fail("Response headers are too large");
+        }
+        if (!waitForData(interrupted)) {
+            return false;
+        }
+    }
+    line = _socket->readLine().trimmed();
+    return true;
+}
+
+bool MdkHttpConnection::readHeaders(Response &response, const Interrupted &interrupted)
+{
+    response = Response();
+
+    QByteArray line;
+    if (!readLine(line, interrupted)) {
+        return false;
+    }
+    // HTTP/1.1 206 Partial Content
+    const QList<QByteArray> statusLine = line.split(' ');
+    if (statusLine.size() < 2 || !statusLine[0].startsWith("HTTP/")) {
+        return fail("Not an HTTP response");
+    }
+    response.status = statusLine[1].toInt();
+    response.keepAlive = statusLine[0] != "HTTP/1.0";
+
+    int64_t headerSize = 0;
+    while (readLine(line, interrupted)) {
+        if (line.isEmpty()) {
+            if (response.contentLength < 0) {
+                // Without a length the body only ends when the connection does
+                return fail("Response without Content-Length");
+            }
+            _used = true;
+            _keepAlive = response.keepAlive;
+            _remaining = response.contentLength;
+            if (_remaining == 0 && !_keepAlive) {
+                close();
+            }
+            return true;
+        }
+        headerSize += line.size();
+        if (headerSize > MAX_HEADER_SIZE) {
+            return fail("Response headers are too large");
+        }
+
+        const int colon = line.indexOf(':');
+        if (colon <= 0) {
+            continue;
+        }
+        const QByteArray name = line.left(colon).trimmed().toLower();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+        if (name == "content-length") {
+            bool ok = false;
+            response.contentLength = value.toLongLong(&ok);
+            if (!ok || response.contentLength < 0) {
+                return fail("Invalid Content-Length");
+            }
+        } else if (name == "content-range") {
+            parseContentRange(value, response);
+        } else if (name == "connection") {
+            const QByteArray option = value.toLower();
+            if (option == "close") {
+                response.keepAlive = false;
+            } else if (option == "keep-alive") {
+                response.keepAlive = true;
+            }
+        } else if (name == "transfer-encoding" && value.toLower() != "identity") {
+            return fail("Chunked responses are not supported");
+        } else if (name == "last-modified") {
+            const QDateTime modified = parseHttpDate(value);
+            if (modified.isValid()) {
+                response.lastModified = modified.toMSecsSinceEpoch();
+            }
+        }
+    }
+    return false;
+}
+
+bool MdkHttpConnection::waitForData(const Interrupted &interrupted)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!_socket->waitForReadyRead(static_cast<int>(WAIT_INTERVAL_MS))) {
+        if (_socket->bytesAvailable() > 0) {
+            return true;
+        }
+        if (_socket->state() != QAbstractSocket::ConnectedState) {
+            return fail("Connection closed by the server");
+        }
+        if (interrupted(timer.elapsed())) {
+            return fail("Interrupted");
+        }
+    }
+    return true;
+}
+
+bool MdkHttpConnection::fail(const QString &error)
+{
+    _error = error;
+    return false;
+}
@@ -0,0 +1,92 @@
+#ifndef MDKHTTPCONNECTION_H
+#define MDKHTTPCONNECTION_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+class QTcpSocket;
+
+/**
+ * A keep-alive HTTP/1.1 connection to a server, for fetching byte ranges
+ * with blocking calls.
+ *
+ * The socket is used without an event loop, so a connection has to be
+ * created and used on one thread. Waits are done in slices of
+ * WAIT_INTERVAL_MS, after each of which the Interrupted callback is asked
+ * whether to give up, given how long nothing has been received.
+ */
+class MdkHttpConnection
+{
+public:
+    /** How often a wait checks whether it is interrupted */
+    static constexpr int64_t WAIT_INTERVAL_MS = 20;
+    /** Limit on the size of the response headers */
+    static constexpr int64_t MAX_HEADER_SIZE = 64 * 1024;
+
+    struct Response {
+        int status = 0;
+        /** Size of the body */
+        int64_t contentLength = -1;
+        /** Position of the body and size of the resource, from Content-Range; -1 if not sent */
+        int64_t rangeStart = -1;
+        int64_t totalSize = -1;
+        /** Last-Modified in ms since the epoch, 0 if not sent or not understood */
+        int64_t lastModified = 0;
+        /** Whether the server keeps the connection open after the body */
+        bool keepAlive = true;
+    };
+
+    /** Called with the time in ms nothing has been received, returns true to give up */
+    using Interrupted = std::function<bool(int64_t elapsedMs)>;
+
+    MdkHttpConnection(const QString &host, quint16 port);
+    ~MdkHttpConnection();
+
+    MdkHttpConnection(const MdkHttpConnection &) = delete;
+    MdkHttpConnection &operator=(const MdkHttpConnection &) = delete;
+
+    /**
+     * Request length bytes at offset of target, the path and query of the
+     * resource, and read the response headers. Connects first if needed,
+     * and once more if the server closed a connection that was idle.
+     */
+    bool request(const QByteArray &target, int64_t offset, int64_t length, Response &response,
+                 const Interrupted &interrupted);
+
+    /** Read at most maxSize bytes of the body. Returns 0 at its end, -1 on errors and if interrupted. */
+    int64_t read(uint8_t *data, int64_t maxSize, const Interrupted &interrupted);
+
+    /** Read and drop the rest of the body, so the connection can be used again */
+    bool discard(const Interrupted &interrupted);
+
+    /** Bytes of the body still to be read */
+    int64_t remaining() const { return _remaining; }
+
+    /** Drop the connection, abandoning the rest of a body */
+    void close();
+
+    const QString &errorString() const { return _error; }
+
+private:
+    bool connect(const Interrupted &interrupted);
+    bool send(const QByteArray &request, const Interrupted &interrupted);
+    bool readLine(QByteArray &line, const Interrupted &interrupted);
+    bool readHeaders(Response &response, const Interrupted &interrupted);
+    /** Wait for more data. False on errors, when the server closes the connection and if interrupted. */
+    bool waitForData(const Interrupted &interrupted);
+    bool fail(const QString &error);
+
+    const QString _host;
+    const quint16 _port;
+    std::unique_ptr<QTcpSocket> _socket;
+    /** Whether a response has been read on this connection, which the server may close when idle */
+    bool _used = false;
+    bool _keepAlive = true;
+    int64_t _remaining = 0;
+    QString _error;
+};
+
+#endif // MDKHTTPCONNECTION_H
@@ -0,0 +1,550 @@
+#include "mdkhttpfileio.h"
+#include "mdktrace.h"
+#include <cstring>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QUrl>
+#include <QtCore/QUrlQuery>
+
+namespace {
+
+/**
+ * Value of an option: the url query item if present, otherwise the MDK
+ * global option "MdkHttpFileIO.<key>". Empty if neither is set.
+ */
+QString option(const QUrlQuery &query, const char *key)
+{
+    if (query.hasQueryItem(key)) {
+        return query.queryItemValue(key);
+    }
+
+    const MDK_NS::OptionVal value = MDK_NS::GetGlobalOption((std::string(MdkHttpFileIO::NAME) + "." + key).c_str());
+    if (const auto *text = std::get_if<std::string>(&value)) {
+        return QString::fromStdString(*text);
+    } else if (const auto *number = std::get_if<int>(&value)) {
+        return QString::number(*number);
+    } else if (const auto *number = std::get_if<int64_t>(&value)) {
+        return QString::number(*number);
+    }
+    return QString();
+}
+
+}
+
+MdkHttpFileIO::MdkHttpFileIO():
+    mdk::MediaIO()
+{
+    // empty
+}
+
+MdkHttpFileIO::~MdkHttpFileIO()
+{
+    stop();
+}
+
+void MdkHttpFileIO::registerOnce()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkHttpFileIO");
+    MediaIO::registerOnce(NAME, []{ return new MdkHttpFileIO();});
+}
+
+const char *MdkHttpFileIO::name() const
+{
+    return NAME;
+}
+
+const std::set<std::string> &MdkHttpFileIO::protocols() const {
+    static const std::set<std::string> s{PROTOCOL};
+    return s;
+}
+
+int64_t MdkHttpFileIO::read(uint8_t *data, int64_t maxSize)
+{
+    MDKIO_TRACE_SPAN(span, "read");
+    if (_threads.empty() || _aborted) {
+        return _aborted ? -1 : 0;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    moveWindow(_position);
+
+    QElapsedTimer timer;
+    timer.start();
+    int64_t bytesRead = 0;
+    while (_position < _size) {
+        // Everything that has arrived from the position on, across blocks
+        while (bytesRead < maxSize && _position < _size) {
+            const int64_t offset = _position - _position % BLOCK_SIZE;
+            const auto found = _blocks.find(offset);
+            if (found == _blocks.end() || found->second.loaded <= _position - offset) {
+                break;
+            }
+            const Block &block = found->second;
+            const int64_t length = qMin(maxSize - bytesRead, block.loaded - (_position - offset));
+            std::memcpy(data + bytesRead, block.data.data() + (_position - offset), static_cast<size_t>(length));
+            bytesRead += length;
+            _position += length;
+        }
+        if (bytesRead > 0) {
+            break;
+        }
+
+        const int64_t offset = _position - _position % BLOCK_SIZE;
+        const auto found = _blocks.find(offset);
+        if (found != _blocks.end() && found->second.failed) {
+            return -1;
+        }
+        if (found != _blocks.end() && found->second.unbuffered) {
+            const int64_t length = qMin(maxSize, qMin(offset + found->second.length, _size) - _position);
+            lock.unlock();
+            bytesRead = fetchUnbuffered(_position, data, length);
+            lock.lock();
+            if (bytesRead <= 0) {
+                return -1;
+            }
+            _position += bytesRead;
+            break;
+        }
+        _blockLoaded.wait_for(lock, std::chrono::milliseconds(WAIT_INTERVAL_MS));
+        if (interrupted(timer.elapsed())) {
+            MDKIO_TRACE(MDK_NS::Debug, "Read at %lld interrupted", static_cast<long long>(_position));
+            return -1;
+        }
+    }
+    moveWindow(_position);
+    MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+    return bytesRead;
+}
+
+bool MdkHttpFileIO::seek(int64_t offset, int from)
+{
+    MDKIO_TRACE_SPAN(span, "seek");
+    if (_threads.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    int64_t position = offset;
+    if (from == SEEK_CUR) {
+        position += _position;
+    } else if (from == SEEK_END) {
+        position += _size;
+    }
+    if (position < 0 || position > _size) {
+        return false;
+    }
+
+    _aborted = false;
+    _position = position;
+    // Failed and unbuffered ranges are tried again
+    for (auto it = _blocks.begin(); it != _blocks.end();) {
+        if ((it->second.failed || it->second.unbuffered) && !it->second.loading) {
+            it = _blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    moveWindow(position);
+    _windowMoved.notify_all();
+    MDKIO_TRACE_SPAN_VALUE(span, position);
+    return true;
+}
+
+int64_t MdkHttpFileIO::position() const
+{
+    return _position;
+}
+
+int64_t MdkHttpFileIO::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return qMax<int64_t>(_size, 0);
+}
+
+bool MdkHttpFileIO::abort()
+{
+    // Picked up by the reading thread within WAIT_INTERVAL_MS
+    _aborted = true;
+    _blockLoaded.notify_all();
+    return true;
+}
+
+bool MdkHttpFileIO::setTimeout(int64_t ms, MDK_NS::TimeoutCallback callback)
+{
+    _timeout = ms;
+    _timeoutCallback = std::move(callback);
+    return true;
+}
+
+bool MdkHttpFileIO::interrupted(int64_t elapsedMs)
+{
+    if (_aborted) {
+        return true;
+    }
+    if (_timeout < 0 || elapsedMs < _timeout) {
+        return false;
+    }
+    return !_timeoutCallback || _timeoutCallback(elapsedMs);
+}
+
+void MdkHttpFileIO::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _windowMoved.notify_all();
+    for (std::thread &thread: _threads) {
+        thread.join();
+    }
+    _threads.clear();
+    _readConnection.reset();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _blocks.clear();
+    _diskFile.reset();
+    _windowStart = 0;
+    _size = -1;
+    _stop = false;
+}
+
+void MdkHttpFileIO::moveWindow(int64_t position)
+{
+    const int64_t start = position - position % BLOCK_SIZE;
+    if (start == _windowStart) {
+        return;
+    }
+    _windowStart = start;
+
+    const int64_t keepFrom = start - KEEP_BEHIND_BLOCKS * BLOCK_SIZE;
+    const int64_t end = start + _windowBlocks * BLOCK_SIZE;
+    for (auto it = _blocks.begin(); it != _blocks.end();) {
+        const bool inside = it->first >= keepFrom && it->first < end;
+        if (it->second.loading) {
+            // Taken up again if a seek brings it back into the window before it's abandoned
+            it->second.cancelled = !inside;
+            ++it;
+        } else if (!inside) {
+            it = _blocks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    _windowMoved.notify_all();
+}
+
+int64_t MdkHttpFileIO::nextBlock() const
+{
+    if (_size < 0) {
+        // The first response tells the size, until then only the first block is fetched
+        return _blocks.count(0) ? -1 : 0;
+    }
+    for (int64_t i = 0; i < _windowBlocks; ++i) {
+        const int64_t offset = _windowStart + i * BLOCK_SIZE;
+        if (offset >= _size) {
+            break;
+        }
+        if (!_blocks.count(offset)) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+void MdkHttpFileIO::run()
+{
+    MdkHttpConnection connection(_host, _port);
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        const int64_t offset = nextBlock();
+        if (offset < 0) {
+            _windowMoved.wait(lock);
+            continue;
+        }
+        fetch(connection, offset, lock);
+    }
+}
+
+void MdkHttpFileIO::fetch(MdkHttpConnection &connection, int64_t offset, std::unique_lock<std::mutex> &lock)
+{
+    MDKIO_TRACE_SPAN(span, "fetch");
+    Block &block = _blocks[offset];
+    block.length = _size < 0 ? BLOCK_SIZE : qMin(BLOCK_SIZE, _size - offset);
+    if (!block.data.allocate(static_cast<size_t>(block.length))) {
+        // The arena is full, read() fetches the range itself
+        block.loading = false;
+        block.unbuffered = true;
+        _blockLoaded.notify_all();
+        return;
+    }
+    const std::shared_ptr<MdkDiskCache::File> diskFile = _diskFile;
+    lock.unlock();
+
+    // Gives up on the range when it is abandoned, and on a connection that stalls
+    const MdkHttpConnection::Interrupted abandoned = [this, &block](int64_t elapsedMs) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _stop || block.cancelled || elapsedMs >= STALL_TIMEOUT_MS;
+    };
+    const MdkHttpConnection::Interrupted stalled = [this](int64_t elapsedMs) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _stop || elapsedMs >= STALL_TIMEOUT_MS;
+    };
+
+    int64_t length = block.length;
+    int64_t bytesRead = 0;
+    bool failed = false;
+    const bool cached = diskFile && diskFile->read(offset, block.data.data(), length);
+    if (cached) {
+        bytesRead = length;
+    }
+    for (int attempt = 1; bytesRead < length && !failed && !abandoned(0); ++attempt) {
+        failed = attempt >= MAX_ATTEMPTS;
+
+        MdkHttpConnection::Response response;
+        if (!connection.request(_target, offset + bytesRead, length - bytesRead, response, abandoned)) {
+            if (!abandoned(0)) {
+                MDKIO_TRACE(MDK_NS::Warning, "Request for %s at %lld failed: %s", qPrintable(_source),
+                            static_cast<long long>(offset + bytesRead), qPrintable(connection.errorString()));
+            }
+            connection.close();
+            continue;
+        }
+        if (response.status == 200 && offset + bytesRead == 0 && response.contentLength <= length) {
+            // The whole resource fits in the range asked for
+            response.rangeStart = 0;
+            response.totalSize = response.contentLength;
+        } else if (response.status == 416 && _size < 0 && response.totalSize == 0) {
+            response.rangeStart = 0;
+        } else if (response.status != 206 || response.rangeStart != offset + bytesRead) {
+            if (response.status == 200 || response.status == 206) {
+                MDKIO_TRACE(MDK_NS::Warning, "%s doesn't support range requests", qPrintable(_source));
+            } else {
+                MDKIO_TRACE(MDK_NS::Warning, "%s answered with status %d", qPrintable(_source), response.status);
+            }
+            connection.close();
+            failed = true;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            if (_size < 0) {
+                setResource(response);
+                if (_size < 0) {
+                    connection.close();
+                    failed = true;
+                    break;
+                }
+                length = block.length = qMin(BLOCK_SIZE, _size);
+            }
+        }
+
+        while (bytesRead < length && connection.remaining() > 0) {
+            const int64_t result = connection.read(block.data.data() + bytesRead, length - bytesRead, abandoned);
+            if (result <= 0) {
+                break;
+            }
+            bytesRead += result;
+            std::lock_guard<std::mutex> guard(_mutex);
+            block.loaded = bytesRead;
+            _blockLoaded.notify_all();
+            if (block.cancelled || _stop) {
+                break;
+            }
+        }
+        if (connection.remaining() > 0) {
+            // An abandoned range close to done is cheaper to finish than a new connection
+            bool drain = false;
+            if (connection.remaining() <= DRAIN_LIMIT) {
+                std::lock_guard<std::mutex> guard(_mutex);
+                drain = block.cancelled && !_stop;
+            }
+            if (!drain || !connection.discard(stalled)) {
+                connection.close();
+            }
+        }
+    }
+
+    if (diskFile && !cached && bytesRead == length) {
+        diskFile->write(offset, block.data.data(), length);
+    }
+
+    lock.lock();
+    block.loading = false;
+    block.loaded = bytesRead;
+    block.failed = failed && bytesRead < length && !block.cancelled && !_stop;
+    if (block.failed) {
+        MDKIO_TRACE(MDK_NS::Warning, "Giving up on %s at %lld", qPrintable(_source), static_cast<long long>(offset));
+    }
+    if (block.cancelled || (bytesRead < length && !block.failed)) {
+        _blocks.erase(offset);
+    }
+    _blockLoaded.notify_all();
+    MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+}
+
+int64_t MdkHttpFileIO::fetchUnbuffered(int64_t offset, uint8_t *data, int64_t length)
+{
+    MDKIO_TRACE_SPAN(span, "fetchUnbuffered");
+    std::shared_ptr<MdkDiskCache::File> diskFile;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        diskFile = _diskFile;
+    }
+    if (diskFile && diskFile->read(offset, data, length)) {
+        return length;
+    }
+
+    if (!_readConnection) {
+        _readConnection = std::make_unique<MdkHttpConnection>(_host, _port);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    const MdkHttpConnection::Interrupted waiting = [this, &timer](int64_t) {
+        return interrupted(timer.elapsed());
+    };
+
+    MdkHttpConnection::Response response;
+    if (!_readConnection->request(_target, offset, length, response, waiting)) {
+        MDKIO_TRACE(MDK_NS::Warning, "Request for %s at %lld failed: %s", qPrintable(_source),
+                    static_cast<long long>(offset), qPrintable(_readConnection->errorString()));
+        _readConnection->close();
+        return -1;
+    }
+    if (response.status == 200 && offset == 0 && response.contentLength <= length) {
+        response.rangeStart = 0;
+        response.totalSize = response.contentLength;
+    } else if (response.status == 416 && offset == 0 && response.totalSize == 0) {
+        response.rangeStart = 0;
+    } else if (response.status != 206 || response.rangeStart != offset) {
+        MDKIO_TRACE(MDK_NS::Warning, "%s answered with status %d", qPrintable(_source), response.status);
+        _readConnection->close();
+        return -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_size < 0) {
+            setResource(response);
+        }
+        if (_size < 0) {
+            _readConnection->close();
+            return -1;
+        }
+    }
+
+    int64_t bytesRead = 0;
+    while (bytesRead < length && _readConnection->remaining() > 0) {
+        const int64_t result = _readConnection->read(data + bytesRead, length - bytesRead, waiting);
+        if (result <= 0) {
+            break;
+        }
+        bytesRead += result;
+    }
+    if (_readConnection->remaining() > 0) {
+        _readConnection->close();
+    }
+    MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+    return (bytesRead > 0 || response.status == 416) ? bytesRead : -1;
+}
+
+void MdkHttpFileIO::setResource(const MdkHttpConnection::Response &response)
+{
+    if (response.totalSize < 0) {
+        MDKIO_TRACE(MDK_NS::Warning, "%s didn't tell its size", qPrintable(_source));
+        return;
+    }
+    _size = response.totalSize;
+    if (_diskCache) {
+        if (response.lastModified != 0) {
+            _diskFile = _diskCache->file(_source, _size, response.lastModified);
+        } else {
+            MDKIO_TRACE(MDK_NS::Info, "%s has no Last-Modified, not caching it on disk", qPrintable(_source));
+        }
+    }
+    _windowMoved.notify_all();
+    _blockLoaded.notify_all();
+}
+
+bool MdkHttpFileIO::onUrlChanged()
+{
+    MDKIO_TRACE_SPAN(span, "open");
+
+    stop();
+    _diskCache.reset();
+    _position = 0;
+    _aborted = false;
+
+    if (url().empty())
+        return true;
+
+    QUrl resourceUrl(QString::fromStdString(url()));
+    QUrlQuery query(resourceUrl);
+    bool ok = false;
+    _connections = option(query, "connections").toInt(&ok);
+    if (!ok || _connections <= 0) {
+        _connections = DEFAULT_CONNECTIONS;
+    }
+    _connections = qMin(_connections, MAX_CONNECTIONS);
+    const QString diskOption = option(query, "disk");
+    if (!diskOption.isEmpty()) {
+        int64_t diskMB = option(query, "disksize").toLongLong(&ok);
+        if (!ok || diskMB <= 0) {
+            diskMB = DEFAULT_DISK_CACHE_MB;
+        }
+        _diskCache = MdkDiskCache::open(diskOption, diskMB * 1024 * 1024);
+    }
+    for (const char *key: {"connections", "disk", "disksize"}) {
+        query.removeAllQueryItems(key);
+    }
+    resourceUrl.setQuery(query);
+    resourceUrl.setScheme("http");
+
+    _host = resourceUrl.host();
+    _port = static_cast<quint16>(resourceUrl.port(80));
+    _target = resourceUrl.path(QUrl::FullyEncoded).toLatin1();
+    if (_target.isEmpty()) {
+        _target = "/";
+    }
+    if (!query.isEmpty()) {
+        _target += '?' + query.toString(QUrl::FullyEncoded).toLatin1();
+    }
+    _source = resourceUrl.toString();
+    if (_host.isEmpty()) {
+        MDKIO_TRACE(MDK_NS::Warning, "No host in %s", url().c_str());
+        return false;
+    }
+
+    // Enough blocks in flight for every connection to be busy with one while the next is queued
+    _windowBlocks = qMax<int64_t>(bufferSize() / BLOCK_SIZE, 2 * _connections);
+    for (int i = 0; i < _connections; ++i) {
+        _threads.emplace_back([this]{ run(); });
+    }
+
+    // The first range tells the size
+    std::unique_lock<std::mutex> lock(_mutex);
+    QElapsedTimer timer;
+    timer.start();
+    while (_size < 0) {
+        const auto first = _blocks.find(0);
+        if (first != _blocks.end() && first->second.unbuffered) {
+            // Only the size is needed
+            lock.unlock();
+            uint8_t byte = 0;
+            const bool fetched = fetchUnbuffered(0, &byte, 1) >= 0;
+            lock.lock();
+            if (fetched) {
+                continue;
+            }
+        }
+        if ((first != _blocks.end() && (first->second.failed || first->second.unbuffered)) ||
+                interrupted(timer.elapsed())) {
+            lock.unlock();
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to open %s", qPrintable(_source));
+            stop();
+            return false;
+        }
+        _blockLoaded.wait_for(lock, std::chrono::milliseconds(WAIT_INTERVAL_MS));
+    }
+    MDKIO_TRACE(MDK_NS::Debug, "Opened %s, %lld bytes, with %d connections", qPrintable(_source),
+                static_cast<long long>(_size), _connections);
+    return true;
+}
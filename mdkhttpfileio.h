@@ -0,0 +1,179 @@
+#ifndef MDKHTTPFILEIO_H
+#define MDKHTTPFILEIO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include "mdkblockarena.h"
+#include "mdkdiskcache.h"
+#include "mdkhttpconnection.h"
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "MediaIO.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/**
+ * MediaIO for media on an HTTP server, such as a content server on the
+ * LAN, for urls like httprange://videos.local:8080/rides/alpe.mp4
+ *
+ * The resource is fetched in ranges of BLOCK_SIZE with HTTP/1.1 Range
+ * requests, by "connections=<n>" threads, each with its own keep-alive
+ * connection. Together they keep a window of bufferSize() bytes ahead of
+ * the read position loading, the blocks nearest to it first, and read()
+ * returns data as soon as it arrives. A seek moves the window, so idle
+ * connections request ranges at the new position right away, and ranges
+ * still arriving outside the window are abandoned: read to the end when
+ * little is left, or by dropping the connection.
+ *
+ * With "disk=<dir>" the fetched data is kept in a disk cache of
+ * "disksize=<MB>", see MdkDiskCache, as long as the server sends a
+ * Last-Modified header to tell whether the copy is still valid. Options
+ * can be set for all urls with SetGlobalOption("MdkHttpFileIO.<key>", ...);
+ * other query items are passed on to the server.
+ *
+ * When the MdkBlockArena is full, blocks that can't get memory are fetched
+ * by read() itself, on a connection of its own, straight into the caller's
+ * buffer.
+ *
+ * The server has to support range requests. Only plain HTTP is spoken.
+ */
+class MdkHttpFileIO: public MDK_NS::MediaIO
+{
+public:
+    static constexpr char const * NAME = "MdkHttpFileIO";
+    static constexpr char const * PROTOCOL = "httprange";
+
+    /** Size of the range fetched by a single request */
+    static constexpr int64_t BLOCK_SIZE = MdkBlockArena::BLOCK_SIZE;
+    /** Default number of connections, see "connections" */
+    static constexpr int DEFAULT_CONNECTIONS = 4;
+    static constexpr int MAX_CONNECTIONS = 16;
+    /** Default size in MB of the disk cache directory, see "disksize" */
+    static constexpr int64_t DEFAULT_DISK_CACHE_MB = 4096;
+    /** Blocks kept behind the read position, for demuxers stepping back a little */
+    static constexpr int64_t KEEP_BEHIND_BLOCKS = 1;
+    /** Bytes of an abandoned range still read to keep its connection, rather than reconnecting */
+    static constexpr int64_t DRAIN_LIMIT = 256 * 1024;
+    /** Time a connection may receive nothing before the range is requested again on a new one */
+    static constexpr int64_t STALL_TIMEOUT_MS = 5000;
+    /** Attempts at fetching a range before reads of it fail */
+    static constexpr int MAX_ATTEMPTS = 3;
+    /** How often a waiting read checks for abort() and timeouts */
+    static constexpr int64_t WAIT_INTERVAL_MS = 20;
+
+    MdkHttpFileIO();
+
+    ~MdkHttpFileIO() override;
+
+    static void registerOnce();
+
+    const char* name() const override;
+
+    const std::set<std::string> &protocols() const override;
+
+    /** Always seekable! */
+    bool isSeekable() const override { return true; }
+    /** We don't need or want any writing done */
+    bool isWritable() const override { return false; }
+
+    /** Read what has arrived at the position, waiting only if nothing has */
+    int64_t read(uint8_t *data, int64_t maxSize) override;
+
+    /** No writing is possible */
+    int64_t write(const uint8_t *, int64_t) override { return 0; }
+
+    /** Seek, fetching from the new position */
+    bool seek(int64_t offset, int from = SEEK_SET) override;
+
+    /** Get the current position */
+    int64_t position() const override;
+
+    /** Get the size of the resource */
+    int64_t size() const override;
+
+    /** Stop waiting for data. Reads fail until the next seek() or url change. */
+    bool abort() override;
+
+    /** Give up waiting for data after ms milliseconds, unless callback returns false */
+    bool setTimeout(int64_t ms, MDK_NS::TimeoutCallback callback) override;
+
+protected:
+    bool onUrlChanged() override;
+private:
+    struct Block {
+        int64_t length = 0;
+        /** Bytes at the start of data that have arrived */
+        int64_t loaded = 0;
+        bool loading = true;
+        bool failed = false;
+        /** There was no memory for the block, read() fetches it itself */
+        bool unbuffered = false;
+        /** Outside the window, to be abandoned by the thread loading it */
+        bool cancelled = false;
+        MdkBlockArena::Data data;
+    };
+
+    /** Whether a read that has been waiting for elapsedMs should give up */
+    bool interrupted(int64_t elapsedMs);
+    void stop();
+    /** Move the window to start at the block of position, abandoning blocks that fall out of it */
+    void moveWindow(int64_t position);
+    /** Offset of the first block in the window that isn't loading or loaded, -1 if none */
+    int64_t nextBlock() const;
+    void run();
+    /** Fetch the block at offset, with the lock held on entry and exit */
+    void fetch(MdkHttpConnection &connection, int64_t offset, std::unique_lock<std::mutex> &lock);
+    /** Fetch an unbuffered block on the reading thread, without the lock */
+    int64_t fetchUnbuffered(int64_t offset, uint8_t *data, int64_t length);
+    /** Set the size and open the disk cache copy, from the first response */
+    void setResource(const MdkHttpConnection::Response &response);
+
+    QString _host;
+    quint16 _port = 80;
+    /** Path and query sent to the server */
+    QByteArray _target;
+    /** Url of the resource, naming its disk cache copy */
+    QString _source;
+    int _connections = DEFAULT_CONNECTIONS;
+    std::shared_ptr<MdkDiskCache> _diskCache;
+    std::shared_ptr<MdkDiskCache::File> _diskFile;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _blockLoaded;
+    std::condition_variable _windowMoved;
+    /** Blocks by offset, those in the window and a few behind it */
+    std::map<int64_t, Block> _blocks;
+    int64_t _windowStart = 0;
+    int64_t _windowBlocks = 0;
+    /** Size of the resource, -1 until the first response */
+    int64_t _size = -1;
+    bool _stop = false;
+    std::vector<std::thread> _threads;
+    /** Used by the reading thread for unbuffered blocks */
+    std::unique_ptr<MdkHttpConnection> _readConnection;
+
+    int64_t _position = 0;
+    std::atomic<bool> _aborted{false};
+    int64_t _timeout = MDK_NS::kTimeout;
+    MDK_NS::TimeoutCallback _timeoutCallback;
+};
+
+#endif // MDKHTTPFILEIO_H
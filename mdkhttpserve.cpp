@@ -0,0 +1,252 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QLocale>
+#include <QtCore/QUrl>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+
+/*
+ * Stand-in for a content server, to try MdkHttpFileIO without one.
+ *
+ * Serves the files in a directory on the loopback interface, over HTTP/1.1
+ * with keep-alive connections and range requests, one thread per
+ * connection. Latency can be added to every response and the rate of every
+ * connection limited, to behave like a busy server or a slow network:
+ *   mdkhttpserve --dir /tmp --latency 20 --rate 40
+ *   mdkiobench --url "httprange://127.0.0.1:8080/mdkiobench.bin"
+ */
+
+namespace {
+
+constexpr int64_t MB = 1024 * 1024;
+/** Size of the pieces a body is sent in, and the rate limited at */
+constexpr int64_t SEND_SIZE = 64 * 1024;
+/** Time an idle connection is kept open */
+constexpr int IDLE_TIMEOUT_MS = 60000;
+
+struct Settings {
+    QString directory;
+    int64_t latencyMs = 0;
+    /** Bytes per second per connection, 0 for no limit */
+    int64_t rate = 0;
+};
+
+bool readLine(QTcpSocket &socket, QByteArray &line)
+{
+    while (!socket.canReadLine()) {
+        if (!socket.waitForReadyRead(IDLE_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+    line = socket.readLine().trimmed();
+    return true;
+}
+
+bool send(QTcpSocket &socket, const QByteArray &data)
+{
+    if (socket.write(data) != data.size()) {
+        return false;
+    }
+    while (socket.bytesToWrite() > 0) {
+        if (!socket.waitForBytesWritten(IDLE_TIMEOUT_MS)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** The IMF-fixdate of HTTP, "Sat, 17 Oct 2026 18:11:54 GMT" */
+QByteArray httpDate(const QDateTime &dateTime)
+{
+    return QLocale::c().toString(dateTime.toUTC(), "ddd, dd MMM yyyy hh:mm:ss 'GMT'").toLatin1();
+}
+
+/** Parse "bytes=<first>-<last>", "bytes=<first>-" and "bytes=-<suffix>" into first and last */
+bool parseRange(const QByteArray &value, int64_t size, int64_t &first, int64_t &last)
+{
+    if (!value.startsWith("bytes=") || value.contains(',')) {
+        return false;
+    }
+    const QByteArray range = value.mid(6);
+    const int dash = range.indexOf('-');
+    if (dash < 0) {
+        return false;
+    }
+    bool ok = false;
+    if (dash == 0) {
+        const int64_t suffix = range.mid(1).toLongLong(&ok);
+        first = qMax<int64_t>(size - suffix, 0);
+        last = size - 1;
+        return ok;
+    }
+    first = range.left(dash).toLongLong(&ok);
+    if (!ok) {
+        return false;
+    }
+    last = dash + 1 < range.size() ? range.mid(dash + 1).toLongLong(&ok) : size - 1;
+    last = qMin(last, size - 1);
+    return ok;
+}
+
+/** Answer one request. Returns false when the connection is to be closed. */
+bool respond(QTcpSocket &socket, const Settings &settings)
+{
+    QByteArray line;
+    if (!readLine(socket, line)) {
+        return false;
+    }
+    // GET /path HTTP/1.1
+    const QList<QByteArray> requestLine = line.split(' ');
+    if (requestLine.size() != 3) {
+        return false;
+    }
+    bool keepAlive = requestLine[2] != "HTTP/1.0";
+    QByteArray range;
+    while (readLine(socket, line) && !line.isEmpty()) {
+        const int colon = line.indexOf(':');
+        const QByteArray name = line.left(colon).trimmed().toLower();
+        const QByteArray value = line.mid(colon + 1).trimmed();
+        if (name == "range") {
+            range = value;
+        } else if (name == "connection") {
+            keepAlive = value.toLower() != "close";
+        }
+    }
+
+    if (settings.latencyMs > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(settings.latencyMs));
+    }
+
+    const QByteArray connection = keepAlive ? "keep-alive" : "close";
+    const QByteArray path = requestLine[1].left(requestLine[1].indexOf('?'));
+    const QString fileName = QDir(settings.directory).filePath(QUrl::fromPercentEncoding(path).mid(1));
+    const QFileInfo info(fileName);
+    QFile file(fileName);
+    if (requestLine[0] != "GET" || !info.canonicalFilePath().startsWith(settings.directory + '/') ||
+            !info.isFile() || !file.open(QFile::ReadOnly)) {
+        send(socket, "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: " + connection + "\r\n\r\n");
+        return keepAlive;
+    }
+
+    const int64_t size = file.size();
+    int64_t first = 0;
+    int64_t last = size - 1;
+    QByteArray headers;
+    if (!range.isEmpty() && parseRange(range, size, first, last)) {
+        if (first >= size) {
+            send(socket, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + QByteArray::number(size) +
+                 "\r\nContent-Length: 0\r\nConnection: " + connection + "\r\n\r\n");
+            return keepAlive;
+        }
+        headers = "HTTP/1.1 206 Partial Content\r\n"
+                "Content-Range: bytes " + QByteArray::number(first) + '-' + QByteArray::number(last) + '/' +
+                QByteArray::number(size) + "\r\n";
+    } else {
+        headers = "HTTP/1.1 200 OK\r\n";
+    }
+    headers += "Content-Length: " + QByteArray::number(last - first + 1) + "\r\n"
+            "Accept-Ranges: bytes\r\n"
+            "Last-Modified: " + httpDate(info.lastModified()) + "\r\n"
+            "Connection: " + connection + "\r\n\r\n";
+    if (!send(socket, headers) || !file.seek(first)) {
+        return false;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray data(SEND_SIZE, '\0');
+    for (int64_t sent = 0; first + sent <= last;) {
+        const int64_t length = file.read(data.data(), qMin(SEND_SIZE, last - first - sent + 1));
+        if (length <= 0 || !send(socket, QByteArray::fromRawData(data.constData(), length))) {
+            return false;
+        }
+        sent += length;
+        if (settings.rate > 0) {
+            const int64_t dueNs = sent * 1000000000 / settings.rate;
+            if (dueNs > timer.nsecsElapsed()) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(dueNs - timer.nsecsElapsed()));
+            }
+        }
+    }
+    return keepAlive;
+}
+
+void serve(qintptr descriptor, Settings settings)
+{
+    QTcpSocket socket;
+    if (!socket.setSocketDescriptor(descriptor)) {
+        return;
+    }
+    while (socket.state() == QAbstractSocket::ConnectedState && respond(socket, settings)) {
+        // next request on the same connection
+    }
+    socket.disconnectFromHost();
+}
+
+class Server: public QTcpServer
+{
+public:
+    explicit Server(const Settings &settings):
+        _settings(settings)
+    {
+        // empty
+    }
+
+protected:
+    /** Every connection is served on its own thread, which creates its own socket */
+    void incomingConnection(qintptr descriptor) override
+    {
+        std::thread(serve, descriptor, _settings).detach();
+    }
+
+private:
+    const Settings _settings;
+};
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Serves a directory on the loopback interface with HTTP range requests");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption({"d", "dir"}, "Directory to serve.", "path", QDir::tempPath()));
+    parser.addOption(QCommandLineOption({"p", "port"}, "Port to listen on.", "port", "8080"));
+    parser.addOption(QCommandLineOption({"l", "latency"}, "Delay before every response.", "ms", "0"));
+    parser.addOption(QCommandLineOption({"r", "rate"}, "Bandwidth of every connection, 0 for no limit.", "MB/s", "0"));
+    parser.process(app);
+
+    Settings settings;
+    settings.directory = QFileInfo(parser.value("dir")).canonicalFilePath();
+    settings.latencyMs = parser.value("latency").toLongLong();
+    settings.rate = parser.value("rate").toLongLong() * MB;
+    if (settings.directory.isEmpty()) {
+        std::fprintf(stderr, "No directory %s\n", qPrintable(parser.value("dir")));
+        return 1;
+    }
+
+    Server server(settings);
+    if (!server.listen(QHostAddress::LocalHost, static_cast<quint16>(parser.value("port").toUInt()))) {
+        std::fprintf(stderr, "Unable to listen: %s\n", qPrintable(server.errorString()));
+        return 1;
+    }
+    std::printf("Serving %s on http://127.0.0.1:%u/ with %lld ms latency\n", qPrintable(settings.directory),
+                server.serverPort(), static_cast<long long>(settings.latencyMs));
+    std::fflush(stdout);
+
+    while (server.waitForNewConnection(-1)) {
+        // connections are handed to incomingConnection()
+    }
+    return 0;
+}
@@ -0,0 +1,12 @@
+QT -= gui
+QT += network
+
+CONFIG += c++1z rtti_off console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Stand-in HTTP server with range requests for trying MdkHttpFileIO, on loopback only:
+#   mdkhttpserve --dir /tmp --latency 20 --rate 40
+SOURCES += \
+        mdkhttpserve.cpp
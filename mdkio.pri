@@ -0,0 +1,87 @@
+# MediaIO implementations and MDK linking, shared by the .pro files of the player and the tools
+
+INCLUDEPATH += $$PWD
+
+# QTcpSocket for MdkHttpFileIO
+QT += network
+
+SOURCES += \
+        $$PWD/mdkaesctr.cpp \
+        $$PWD/mdkaesfileio.cpp \
+        $$PWD/mdkalignedbufferpool.cpp \
+        $$PWD/mdkblockarena.cpp \
+        $$PWD/mdkblockcache.cpp \
+        $$PWD/mdkconcatfileio.cpp \
+        $$PWD/mdkdirectfile.cpp \
+        $$PWD/mdkdiskcache.cpp \
+        $$PWD/mdkfilemapping.cpp \
+        $$PWD/mdkhttpconnection.cpp \
+        $$PWD/mdkhttpfileio.cpp \
+        $$PWD/mdkiostats.cpp \
+        $$PWD/mdkiotrace.cpp \
+        $$PWD/mdklocalfileio.cpp \
+        $$PWD/mdkmemoryio.cpp \
+        $$PWD/mdkmp4prefetch.cpp \
+        $$PWD/mdkpreloader.cpp \
+        $$PWD/mdkreadahead.cpp \
+        $$PWD/mdkseekindex.cpp \
+        $$PWD/mdksharedfile.cpp \
+        $$PWD/mdksignal.cpp \
+        $$PWD/mdkstagingbuffer.cpp \
+        $$PWD/mdkstreamreader.cpp \
+        $$PWD/mdksupport.cpp \
+        $$PWD/mdktrace.cpp \
+        $$PWD/mdkuringfileio.cpp
+
+HEADERS += \
+        $$PWD/mdkaesctr.h \
+        $$PWD/mdkaesfileio.h \
+        $$PWD/mdkalignedbufferpool.h \
+        $$PWD/mdkblockarena.h \
+        $$PWD/mdkblockcache.h \
+        $$PWD/mdkconcatfileio.h \
+        $$PWD/mdkdirectfile.h \
+        $$PWD/mdkdiskcache.h \
+        $$PWD/mdkendian.h \
+        $$PWD/mdkfilemapping.h \
+        $$PWD/mdkhttpconnection.h \
+        $$PWD/mdkhttpfileio.h \
+        $$PWD/mdkiostats.h \
+        $$PWD/mdkiotrace.h \
+        $$PWD/mdklocalfileio.h \
+        $$PWD/mdkmemoryio.h \
+        $$PWD/mdkmp4prefetch.h \
+        $$PWD/mdkpreloader.h \
+        $$PWD/mdkreadahead.h \
+        $$PWD/mdkseekindex.h \
+        $$PWD/mdksharedfile.h \
+        $$PWD/mdksignal.h \
+        $$PWD/mdkspscring.h \
+        $$PWD/mdkstagingbuffer.h \
+        $$PWD/mdkstreamreader.h \
+        $$PWD/mdksupport.h \
+        $$PWD/mdktrace.h \
+        $$PWD/mdkuringfileio.h
+
+win32 {
+# MDK (Media Development Kit)
+MDK_DIR = D:\Development\mdk-sdk
+INCLUDEPATH += $$MDK_DIR/include
+LIBS += $$MDK_DIR/lib/x64/mdk.lib
+} 
+macx {
+LIBS += -framework mdk
+}
+linux {
+# MDK (Media Development Kit), override with qmake MDK_DIR=...
+isEmpty(MDK_DIR): MDK_DIR = /opt/mdk-sdk
+INCLUDEPATH += $$MDK_DIR/include
+LIBS += -L$$MDK_DIR/lib/amd64 -lmdk
+
+# io_uring support for MdkUringFileIO, which falls back to QFile without it
+CONFIG += link_pkgconfig
+packagesExist(liburing) {
+PKGCONFIG += liburing
+DEFINES += HAVE_LIBURING
+}
+}
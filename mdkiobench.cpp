@@ -0,0 +1,414 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+
+#include "mdkiotool.h"
+#include "mdklocalfileio.h"
+#include "mdkmemoryio.h"
+#include "mdksupport.h"
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "MediaIO.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/*
+ * Benchmark for the registered MediaIO implementations, without a player.
+ *
+ * Every url template (%1 is replaced by the path of the test file) is run
+ * against synthetic access patterns, reporting throughput, read latency
+ * percentiles, the number of stalls, the time taken to open the url and, on
+ * Linux, read syscalls per MB and the bytes they returned, taken from
+ * /proc/self/io. Those only count read()-family calls, so they are near zero
+ * for mmap and io_uring and leave out copies made in user space. For
+ * MdkLocalFileIO the reads it passed on to the file per MB are reported as
+ * well, which staging reduces.
+ *
+ * With --memory the file is also loaded in memory and run as memory:mdkiobench
+ * through MdkMemoryIO, a baseline of what the patterns cost without any disk.
+ */
+
+namespace {
+
+/** Size of the reads done by a demuxer with FFmpeg's default AVIO buffer */
+constexpr int64_t DEMUX_READ_SIZE = 32 * 1024;
+constexpr int64_t MB = 1024 * 1024;
+/** Reads taking longer than this are counted as stalls, long enough to hold up decoding */
+constexpr int64_t STALL_NS = 1000000;
+/** Size of a GOP in the patterns that seek to key frames */
+constexpr int64_t GOP_SIZE = 2 * MB;
+/** Time the trick play patterns spend decoding after each seek, giving read-ahead a chance */
+constexpr auto DECODE_TIME = std::chrono::milliseconds(10);
+
+/** Name of the test file loaded in memory with --memory */
+const char *const MEMORY_NAME = "mdkiobench";
+
+const char *const DEFAULT_URLS[] = {
+    "localfile://%1",
+    "localfile://%1?staging=256",
+    "localfile://%1?io=mmap",
+    "localfile://%1?io=readahead",
+    "localfile://%1?cache=256",
+    "localfile://%1?io=direct",
+    "uringfile://%1",
+};
+
+/** Read syscalls and the bytes they returned for this process, -1 where not available */
+struct ProcessIo {
+    int64_t syscalls = -1;
+    int64_t syscallBytes = -1;
+};
+
+ProcessIo processIo()
+{
+    ProcessIo result;
+#if defined Q_OS_LINUX
+    QFile io("/proc/self/io");
+    if (!io.open(QFile::ReadOnly)) {
+        return result;
+    }
+    for (const QByteArray &line: io.readAll().split('\n')) {
+        if (line.startsWith("syscr: ")) {
+            result.syscalls = line.mid(7).toLongLong();
+        } else if (line.startsWith("rchar: ")) {
+            result.syscallBytes = line.mid(7).toLongLong();
+        }
+    }
+#endif
+    return result;
+}
+
+struct Result {
+    int64_t bytes = 0;
+    int64_t reads = 0;
+    int64_t seeks = 0;
+    /** Time to create and open the MediaIO, not included in elapsedNs */
+    int64_t openNs = 0;
+    int64_t elapsedNs = 0;
+    /** Reads MdkLocalFileIO passed on to the file, -1 for other MediaIO implementations */
+    int64_t fileReads = -1;
+    std::vector<int64_t> readLatenciesNs;
+    ProcessIo io;
+};
+
+/** Forwards to a MediaIO, timing every read */
+class Driver
+{
+public:
+    Driver(MDK_NS::MediaIO &io, Result &result):
+        _io(io),
+        _result(result),
+        _buffer(static_cast<size_t>(MB))
+    {
+        // empty
+    }
+
+    int64_t size() const { return _io.size(); }
+
+    int64_t read(int64_t size)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        const int64_t bytesRead = _io.read(_buffer.data(), qMin(size, static_cast<int64_t>(_buffer.size())));
+        _result.readLatenciesNs.push_back(timer.nsecsElapsed());
+        ++_result.reads;
+        if (bytesRead > 0) {
+            _result.bytes += bytesRead;
+        }
+        return bytesRead;
+    }
+
+    /** Read size bytes in demuxer-sized pieces */
+    void readFully(int64_t size)
+    {
+        while (size > 0) {
+            const int64_t bytesRead = read(qMin(size, DEMUX_READ_SIZE));
+            if (bytesRead <= 0) {
+                break;
+            }
+            size -= bytesRead;
+        }
+    }
+
+    bool seek(int64_t offset, int from = SEEK_SET)
+    {
+        ++_result.seeks;
+        return _io.seek(offset, from);
+    }
+
+private:
+    MDK_NS::MediaIO &_io;
+    Result &_result;
+    std::vector<uint8_t> _buffer;
+};
+
+using Pattern = void (*)(Driver &driver, int64_t budget, std::mt19937_64 &random);
+
+/** Read the file from the start in demuxer-sized reads */
+void sequential(Driver &driver, int64_t budget, std::mt19937_64 &)
+{
+    driver.seek(0);
+    driver.readFully(budget);
+}
+
+/** Box/packet header reads followed by packet reads, seeking back and forth now and then */
+void demuxer(Driver &driver, int64_t budget, std::mt19937_64 &random)
+{
+    const int64_t size = driver.size();
+    std::uniform_int_distribution<int64_t> packetSize(512, 256 * 1024);
+    std::uniform_int_distribution<int64_t> seekDistance(-16 * MB, 16 * MB);
+
+    int64_t position = 0;
+    int64_t bytesRead = 0;
+    driver.seek(0);
+    for (int packet = 1; bytesRead < budget; ++packet) {
+        if (packet % 500 == 0) {
+            position = qBound<int64_t>(0, position + seekDistance(random), size);
+            driver.seek(position);
+        }
+        int64_t header = driver.read(8);
+        int64_t payload = 0;
+        const int64_t length = packetSize(random);
+        while (payload < length) {
+            const int64_t chunk = driver.read(qMin(length - payload, DEMUX_READ_SIZE));
+            if (chunk <= 0) {
+                break;
+            }
+            payload += chunk;
+        }
+        if (header <= 0 || payload < length) {
+            // Wrapped around at the end of the file
+            position = 0;
+            driver.seek(0);
+        } else {
+            position += header + payload;
+        }
+        bytesRead += qMax<int64_t>(0, header) + payload;
+    }
+}
+
+/** Random seeks, each followed by reading a GOP worth of data */
+void keyFrameSeeks(Driver &driver, int64_t budget, std::mt19937_64 &random)
+{
+    std::uniform_int_distribution<int64_t> target(0, qMax<int64_t>(0, driver.size() - GOP_SIZE));
+    for (int64_t bytesRead = 0; bytesRead < budget; bytesRead += GOP_SIZE) {
+        driver.seek(target(random));
+        driver.readFully(GOP_SIZE);
+    }
+}
+
+/** Reverse playback: from the end, seek back one GOP at a time and decode it */
+void reverse(Driver &driver, int64_t budget, std::mt19937_64 &)
+{
+    const int64_t last = qMax<int64_t>(0, driver.size() - GOP_SIZE) / GOP_SIZE * GOP_SIZE;
+    int64_t position = last;
+    for (int64_t bytesRead = 0; bytesRead < budget; bytesRead += GOP_SIZE) {
+        driver.seek(position);
+        driver.readFully(GOP_SIZE);
+        std::this_thread::sleep_for(DECODE_TIME);
+        position = (position >= GOP_SIZE) ? position - GOP_SIZE : last;
+    }
+}
+
+/** Fast forward at 8x: only the key frame at the start of every 8th GOP is decoded */
+void trickPlay(Driver &driver, int64_t budget, std::mt19937_64 &)
+{
+    const int64_t keyFrameSize = 256 * 1024;
+    const int64_t stride = 8 * GOP_SIZE;
+    int64_t position = 0;
+    for (int64_t bytesRead = 0; bytesRead < budget; bytesRead += keyFrameSize) {
+        driver.seek(position);
+        driver.readFully(keyFrameSize);
+        std::this_thread::sleep_for(DECODE_TIME);
+        position = (position + stride + keyFrameSize <= driver.size()) ? position + stride : 0;
+    }
+}
+
+/** Probing as done when opening an MP4 with a trailing moov: head, tail, back to somewhere */
+void seekEndProbes(Driver &driver, int64_t budget, std::mt19937_64 &random)
+{
+    const int64_t size = driver.size();
+    std::uniform_int_distribution<int64_t> tail(8, qMin<int64_t>(4 * MB, size));
+    std::uniform_int_distribution<int64_t> target(0, size);
+    for (int64_t bytesRead = 0; bytesRead < budget; bytesRead += 128 * 1024) {
+        driver.seek(0);
+        driver.read(32);
+        driver.seek(-8, SEEK_END);
+        driver.read(8);
+        driver.seek(-tail(random), SEEK_END);
+        driver.readFully(64 * 1024);
+        driver.seek(target(random));
+        driver.readFully(DEMUX_READ_SIZE);
+    }
+}
+
+/** Parsing boxes: header reads of a few bytes, reading small boxes and skipping the others */
+void boxes(Driver &driver, int64_t budget, std::mt19937_64 &random)
+{
+    std::uniform_int_distribution<int64_t> boxSize(16, 4096);
+    std::bernoulli_distribution skip(0.25);
+    driver.seek(0);
+    for (int64_t bytesRead = 0; bytesRead < budget;) {
+        const int64_t header = driver.read(8);
+        if (header <= 0) {
+            driver.seek(0);
+            continue;
+        }
+        const int64_t size = boxSize(random);
+        if (skip(random)) {
+            driver.seek(size, SEEK_CUR);
+        } else {
+            driver.readFully(size);
+        }
+        bytesRead += header + size;
+    }
+}
+
+struct NamedPattern {
+    const char *name;
+    Pattern run;
+    /** Part of the file size read by this pattern */
+    int64_t budgetDivisor;
+};
+
+const NamedPattern PATTERNS[] = {
+    {"sequential", sequential, 1},
+    {"demuxer", demuxer, 1},
+    {"boxes", boxes, 16},
+    {"keyframe", keyFrameSeeks, 4},
+    {"reverse", reverse, 4},
+    {"trickplay", trickPlay, 64},
+    {"seekend", seekEndProbes, 64},
+};
+
+void report(const QString &url, const char *pattern, Result &result)
+{
+    std::sort(result.readLatenciesNs.begin(), result.readLatenciesNs.end());
+    const auto stalls = result.readLatenciesNs.end() -
+            std::upper_bound(result.readLatenciesNs.begin(), result.readLatenciesNs.end(), STALL_NS);
+    const double megabytes = static_cast<double>(result.bytes) / MB;
+    const double seconds = static_cast<double>(result.elapsedNs) / 1e9;
+
+    std::printf("%-42s %-10s %9.1f MB/s  open %8.1f ms  p50 %8.1f us  p99 %8.1f us  p999 %9.1f us  %6lld stalls",
+                qPrintable(url), pattern,
+                seconds > 0 ? megabytes / seconds : 0.0,
+                result.openNs / 1e6,
+                percentile(result.readLatenciesNs, 0.5) / 1e3,
+                percentile(result.readLatenciesNs, 0.99) / 1e3,
+                percentile(result.readLatenciesNs, 0.999) / 1e3,
+                static_cast<long long>(stalls));
+    if (result.fileReads >= 0 && megabytes > 0) {
+        std::printf("  %8.1f file reads/MB", static_cast<double>(result.fileReads) / megabytes);
+    }
+    if (result.io.syscalls >= 0 && megabytes > 0) {
+        std::printf("  %8.1f syscalls/MB  %9.1f syscall MB",
+                    static_cast<double>(result.io.syscalls) / megabytes,
+                    static_cast<double>(result.io.syscallBytes) / MB);
+    }
+    std::printf("\n");
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks registered MediaIO implementations on a generated file");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption({"f", "file"}, "Test file, generated if missing or of the wrong size.", "path",
+                                        QDir::temp().filePath("mdkiobench.bin")));
+    parser.addOption(QCommandLineOption({"s", "size"}, "Size of the test file in MB.", "MB", "1024"));
+    parser.addOption(QCommandLineOption({"u", "url"}, "Url template to test, %1 is the file path. Can be repeated.", "url"));
+    parser.addOption(QCommandLineOption({"p", "pattern"}, "Only run this access pattern. Can be repeated.", "name"));
+    parser.addOption(QCommandLineOption({"c", "cold"}, "Drop the file from the page cache before every run."));
+    parser.addOption(QCommandLineOption({"m", "memory"}, "Also run on the file loaded in memory, as a baseline without disk."));
+    parser.process(app);
+
+    const QString fileName = parser.value("file");
+    const int64_t size = parser.value("size").toLongLong() * MB;
+    if (size <= 0 || !generate(fileName, size)) {
+        std::fprintf(stderr, "Unable to create %s\n", qPrintable(fileName));
+        return 1;
+    }
+
+    QStringList urls = parser.values("url");
+    if (urls.isEmpty()) {
+        for (const char *url: DEFAULT_URLS) {
+            urls << QString(url);
+        }
+    }
+    const QStringList patterns = parser.values("pattern");
+
+    registerMediaIoClasses();
+
+    if (parser.isSet("memory")) {
+        QFile file(fileName);
+        if (!file.open(QFile::ReadOnly)) {
+            std::fprintf(stderr, "Unable to load %s\n", qPrintable(fileName));
+            return 1;
+        }
+        MdkMemoryIO::setBuffer(MEMORY_NAME, file.readAll());
+        urls << QString(MdkMemoryIO::PROTOCOL) + ":" + MEMORY_NAME;
+    }
+
+    for (const QString &urlTemplate: urls) {
+        const QString url = urlTemplate.contains("%1") ? urlTemplate.arg(fileName) : urlTemplate;
+        for (const NamedPattern &pattern: PATTERNS) {
+            if (!patterns.isEmpty() && std::find(patterns.begin(), patterns.end(), QString(pattern.name)) == patterns.end()) {
+                continue;
+            }
+            if (parser.isSet("cold")) {
+                dropCache(fileName);
+            }
+
+            Result result;
+            const ProcessIo before = processIo();
+            QElapsedTimer timer;
+            timer.start();
+
+            std::unique_ptr<MDK_NS::MediaIO> io(MDK_NS::MediaIO::createForUrl(url.toStdString()));
+            if (!io) {
+                std::fprintf(stderr, "No MediaIO for %s\n", qPrintable(url));
+                break;
+            }
+            // Opening includes whatever is prefetched then, which the patterns shouldn't be charged for
+            result.openNs = timer.nsecsElapsed();
+            timer.restart();
+            Driver driver(*io, result);
+            std::mt19937_64 random(1);
+            pattern.run(driver, size / pattern.budgetDivisor, random);
+            if (std::string(io->name()) == MdkLocalFileIO::NAME) {
+                result.fileReads = static_cast<int64_t>(static_cast<MdkLocalFileIO&>(*io).stats().fileReads);
+            }
+            io.reset();
+
+            result.elapsedNs = timer.nsecsElapsed();
+            const ProcessIo after = processIo();
+            if (before.syscalls >= 0 && after.syscalls >= 0) {
+                result.io.syscalls = after.syscalls - before.syscalls;
+                result.io.syscallBytes = after.syscallBytes - before.syscallBytes;
+            }
+            report(url, pattern.name, result);
+        }
+    }
+    return 0;
+}
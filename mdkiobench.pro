@@ -0,0 +1,17 @@
+QT -= gui
+
+CONFIG += c++1z rtti_off console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Benchmark for the MediaIO implementations, without a player:
+#   mdkiobench --size 2048 --cold --pattern keyframe --url "localfile://%1?io=mmap"
+SOURCES += \
+        mdkiobench.cpp \
+        mdkiotool.cpp
+
+HEADERS += \
+        mdkiotool.h
+
+include(mdkio.pri)
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include <QtCore/QCommandLineParser>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include "mdkiotool.h"
+#include "mdkiotrace.h"
+#include "mdksupport.h"
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "MediaIO.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/*
+ * Replays a trace of the calls MDK made on MdkLocalFileIO, recorded with
+ * "record=<directory>", against any registered MediaIO.
+ *
+ * The calls are made on the file given, or on a generated file of the size
+ * of the recorded one, so traces of large videos can be replayed anywhere.
+ * Reported are the time to open the url, the time until STARTUP_BYTES were
+ * read, throughput, read latency percentiles, the latency from a seek to
+ * the data after it, and calls whose result differs from the recording.
+ * With --realtime calls are made no earlier than they were recorded,
+ * otherwise as fast as possible.
+ */
+
+namespace {
+
+constexpr int64_t MB = 1024 * 1024;
+/** Data read before playback can start, for the startup time */
+constexpr int64_t STARTUP_BYTES = 2 * MB;
+
+struct Result {
+    int64_t calls = 0;
+    int64_t bytes = 0;
+    int64_t mismatches = 0;
+    int64_t openNs = 0;
+    /** -1 if fewer than STARTUP_BYTES were read */
+    int64_t startupNs = -1;
+    int64_t elapsedNs = 0;
+    std::vector<int64_t> readLatenciesNs;
+    /** From the start of a seek to the end of the first read after it */
+    std::vector<int64_t> seekLatenciesNs;
+};
+
+bool replay(const QString &url, const std::vector<MdkIoTrace::Entry> &entries, bool realtime, Result &result)
+{
+    QElapsedTimer timer;
+    timer.start();
+    std::unique_ptr<MDK_NS::MediaIO> io(MDK_NS::MediaIO::createForUrl(url.toStdString()));
+    if (!io) {
+        return false;
+    }
+    result.openNs = timer.nsecsElapsed();
+
+    std::vector<uint8_t> buffer;
+    int64_t seekStart = -1;
+    for (const MdkIoTrace::Entry &entry: entries) {
+        if (realtime) {
+            const int64_t wait = entry.time - timer.nsecsElapsed();
+            if (wait > 0) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+            }
+        }
+
+        const int64_t start = timer.nsecsElapsed();
+        int64_t value = 0;
+        switch (entry.call) {
+        case MdkIoTrace::Call::Read:
+            if (buffer.size() < static_cast<size_t>(entry.argument)) {
+                buffer.resize(static_cast<size_t>(entry.argument));
+            }
+            value = io->read(buffer.data(), entry.argument);
+            if (value > 0) {
+                result.bytes += value;
+            }
+            break;
+        case MdkIoTrace::Call::Seek:
+            value = io->seek(entry.argument, entry.whence) ? 1 : 0;
+            break;
+        case MdkIoTrace::Call::Size:
+            value = io->size();
+            break;
+        case MdkIoTrace::Call::Position:
+            value = io->position();
+            break;
+        }
+        const int64_t end = timer.nsecsElapsed();
+
+        ++result.calls;
+        if (value != entry.result) {
+            ++result.mismatches;
+        }
+        if (entry.call == MdkIoTrace::Call::Read) {
+            result.readLatenciesNs.push_back(end - start);
+            if (seekStart >= 0) {
+                result.seekLatenciesNs.push_back(end - seekStart);
+                seekStart = -1;
+            }
+            if (result.startupNs < 0 && result.bytes >= STARTUP_BYTES) {
+                result.startupNs = end;
+            }
+        } else if (entry.call == MdkIoTrace::Call::Seek && seekStart < 0) {
+            seekStart = start;
+        }
+    }
+    io.reset();
+    result.elapsedNs = timer.nsecsElapsed();
+    return true;
+}
+
+void report(const QString &url, Result &result)
+{
+    std::sort(result.readLatenciesNs.begin(), result.readLatenciesNs.end());
+    std::sort(result.seekLatenciesNs.begin(), result.seekLatenciesNs.end());
+    const double megabytes = static_cast<double>(result.bytes) / MB;
+    const double seconds = static_cast<double>(result.elapsedNs) / 1e9;
+
+    std::printf("%-42s %8lld calls  open %7.2f ms  startup %8.2f ms  %9.1f MB/s  read p50 %7.1f us  p99 %8.1f us"
+                "  seek p50 %8.1f us  p99 %9.1f us  %lld mismatches\n",
+                qPrintable(url), static_cast<long long>(result.calls),
+                result.openNs / 1e6,
+                result.startupNs >= 0 ? result.startupNs / 1e6 : 0.0,
+                seconds > 0 ? megabytes / seconds : 0.0,
+                percentile(result.readLatenciesNs, 0.5) / 1e3,
+                percentile(result.readLatenciesNs, 0.99) / 1e3,
+                percentile(result.seekLatenciesNs, 0.5) / 1e3,
+                percentile(result.seekLatenciesNs, 0.99) / 1e3,
+                static_cast<long long>(result.mismatches));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded MediaIO trace against registered MediaIO implementations");
+    parser.addHelpOption();
+    parser.addPositionalArgument("trace", "Trace recorded with the \"record\" option of MdkLocalFileIO.");
+    parser.addOption(QCommandLineOption({"f", "file"}, "File to replay on, instead of a generated file of the recorded size.", "path"));
+    parser.addOption(QCommandLineOption({"u", "url"}, "Url template to replay on, %1 is the file path. Can be repeated.", "url"));
+    parser.addOption(QCommandLineOption({"r", "realtime"}, "Make the calls no earlier than they were recorded."));
+    parser.addOption(QCommandLineOption({"c", "cold"}, "Drop the file from the page cache before every replay."));
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+    int64_t size = 0;
+    std::vector<MdkIoTrace::Entry> entries;
+    const QString traceName = parser.positionalArguments().first();
+    if (!MdkIoTrace::load(traceName, size, entries)) {
+        std::fprintf(stderr, "Unable to read trace %s\n", qPrintable(traceName));
+        return 1;
+    }
+
+    QString fileName = parser.value("file");
+    if (fileName.isEmpty()) {
+        fileName = QDir::temp().filePath(QString("mdkioreplay-%1.bin").arg(size));
+        if (!generate(fileName, size)) {
+            std::fprintf(stderr, "Unable to create %s\n", qPrintable(fileName));
+            return 1;
+        }
+    } else if (QFileInfo(fileName).size() != size) {
+        std::fprintf(stderr, "%s is not %lld bytes like the recorded file, results will differ\n",
+                     qPrintable(fileName), static_cast<long long>(size));
+    }
+    std::printf("Replaying %d calls on %lld bytes\n", static_cast<int>(entries.size()), static_cast<long long>(size));
+
+    QStringList urls = parser.values("url");
+    if (urls.isEmpty()) {
+        urls << QString("localfile://%1");
+    }
+
+    registerMediaIoClasses();
+
+    for (const QString &urlTemplate: urls) {
+        const QString url = urlTemplate.arg(fileName);
+        if (parser.isSet("cold")) {
+            dropCache(fileName);
+        }
+        Result result;
+        if (!replay(url, entries, parser.isSet("realtime"), result)) {
+            std::fprintf(stderr, "No MediaIO for %s\n", qPrintable(url));
+            continue;
+        }
+        report(url, result);
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+QT -= gui
+
+CONFIG += c++1z rtti_off console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Replays a trace recorded with "record=<directory>" against MediaIO implementations:
+#   mdkioreplay --url "localfile://%1?io=readahead" --realtime ride.mp4.mdkiotrace
+SOURCES += \
+        mdkioreplay.cpp \
+        mdkiotool.cpp
+
+HEADERS += \
+        mdkiotool.h
+
+include(mdkio.pri)
@@ -0,0 +1,195 @@
+#include "mdkiostats.h"
+#include "mdkblockarena.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+std::mutex listenerMutex;
+std::shared_ptr<const MDK_NS::MediaEventListener> eventListener;
+
+}
+
+uint64_t MdkIoStats::Histogram::total() const
+{
+    uint64_t total = 0;
+    for (uint64_t count: counts) {
+        total += count;
+    }
+    return total;
+}
+
+int64_t MdkIoStats::Histogram::percentileUs(double fraction) const
+{
+    const uint64_t total = this->total();
+    if (total == 0) {
+        return 0;
+    }
+    const uint64_t rank = static_cast<uint64_t>(fraction * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen > rank) {
+            return int64_t(1) << i;
+        }
+    }
+    return int64_t(1) << (LATENCY_BUCKETS - 1);
+}
+
+int64_t MdkIoStats::Snapshot::prefetchSavedNs() const
+{
+    const uint64_t misses = fileReads - std::min(fileReads, prefetchHits);
+    if (prefetchedBytes == 0 || misses == 0) {
+        return -static_cast<int64_t>(prefetchNs);
+    }
+    const double averageNs = static_cast<double>(fileReadNs) / static_cast<double>(misses);
+    return static_cast<int64_t>(averageNs * static_cast<double>(prefetchHits)) - static_cast<int64_t>(prefetchNs);
+}
+
+std::string MdkIoStats::Snapshot::toString() const
+{
+    return "bytes=" + std::to_string(bytesRead) +
+            " reads=" + std::to_string(readCalls) +
+            " fileReads=" + std::to_string(fileReads) +
+            " short=" + std::to_string(shortReads) +
+            " errors=" + std::to_string(readErrors) +
+            " seeks=" + std::to_string(seeks) +
+            " seekDistance=" + std::to_string(seekDistance) +
+            " readP50us=" + std::to_string(readLatency.percentileUs(0.5)) +
+            " readP99us=" + std::to_string(readLatency.percentileUs(0.99)) +
+            " readP999us=" + std::to_string(readLatency.percentileUs(0.999)) +
+            " seekP99us=" + std::to_string(seekLatency.percentileUs(0.99)) +
+            " prefetched=" + std::to_string(prefetchedBytes) +
+            " prefetchUs=" + std::to_string(prefetchNs / 1000) +
+            " prefetchHits=" + std::to_string(prefetchHits) +
+            " prefetchHitBytes=" + std::to_string(prefetchHitBytes) +
+            " prefetchSavedUs=" + std::to_string(prefetchSavedNs() / 1000) +
+            " readAheadDepth=" + std::to_string(readAheadDepth) +
+            " readRate=" + std::to_string(readRate) +
+            " loadLatencyUs=" + std::to_string(loadLatencyNs / 1000) +
+            " readAheadStride=" + std::to_string(readAheadStride) +
+            " readAheadStalls=" + std::to_string(readAheadStalls);
+}
+
+void MdkIoStats::recordRead(int64_t requested, int64_t result, int64_t nanoseconds)
+{
+    add(_readCalls, 1);
+    if (result < 0) {
+        add(_readErrors, 1);
+    } else {
+        add(_bytesRead, static_cast<uint64_t>(result));
+        if (result < requested) {
+            add(_shortReads, 1);
+        }
+    }
+    add(_readLatency[bucket(nanoseconds)], 1);
+}
+
+void MdkIoStats::recordFileRead()
+{
+    add(_fileReads, 1);
+}
+
+void MdkIoStats::recordFileReadTime(int64_t nanoseconds)
+{
+    add(_fileReadNs, static_cast<uint64_t>(std::max<int64_t>(0, nanoseconds)));
+}
+
+void MdkIoStats::recordSeek(int64_t from, int64_t to, int64_t nanoseconds)
+{
+    add(_seeks, 1);
+    add(_seekDistance, static_cast<uint64_t>(to > from ? to - from : from - to));
+    add(_seekLatency[bucket(nanoseconds)], 1);
+}
+
+void MdkIoStats::recordPrefetch(int64_t bytes, int64_t nanoseconds)
+{
+    add(_prefetchedBytes, static_cast<uint64_t>(std::max<int64_t>(0, bytes)));
+    add(_prefetchNs, static_cast<uint64_t>(std::max<int64_t>(0, nanoseconds)));
+}
+
+void MdkIoStats::recordPrefetchHit(int64_t bytes)
+{
+    add(_prefetchHits, 1);
+    add(_prefetchHitBytes, static_cast<uint64_t>(bytes));
+}
+
+void MdkIoStats::recordReadAhead(int64_t depth, int64_t readRate, int64_t loadLatencyNs, int64_t stride, int64_t stalls)
+{
+    _readAheadDepth.store(static_cast<uint64_t>(std::max<int64_t>(0, depth)), std::memory_order_relaxed);
+    _readRate.store(static_cast<uint64_t>(std::max<int64_t>(0, readRate)), std::memory_order_relaxed);
+    _loadLatencyNs.store(static_cast<uint64_t>(std::max<int64_t>(0, loadLatencyNs)), std::memory_order_relaxed);
+    _readAheadStride.store(stride, std::memory_order_relaxed);
+    _readAheadStalls.store(static_cast<uint64_t>(std::max<int64_t>(0, stalls)), std::memory_order_relaxed);
+}
+
+MdkIoStats::Snapshot MdkIoStats::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.bytesRead = _bytesRead.load(std::memory_order_relaxed);
+    snapshot.readCalls = _readCalls.load(std::memory_order_relaxed);
+    snapshot.fileReads = _fileReads.load(std::memory_order_relaxed);
+    snapshot.shortReads = _shortReads.load(std::memory_order_relaxed);
+    snapshot.readErrors = _readErrors.load(std::memory_order_relaxed);
+    snapshot.seeks = _seeks.load(std::memory_order_relaxed);
+    snapshot.seekDistance = _seekDistance.load(std::memory_order_relaxed);
+    snapshot.prefetchedBytes = _prefetchedBytes.load(std::memory_order_relaxed);
+    snapshot.prefetchNs = _prefetchNs.load(std::memory_order_relaxed);
+    snapshot.prefetchHits = _prefetchHits.load(std::memory_order_relaxed);
+    snapshot.prefetchHitBytes = _prefetchHitBytes.load(std::memory_order_relaxed);
+    snapshot.fileReadNs = _fileReadNs.load(std::memory_order_relaxed);
+    snapshot.readAheadDepth = _readAheadDepth.load(std::memory_order_relaxed);
+    snapshot.readRate = _readRate.load(std::memory_order_relaxed);
+    snapshot.loadLatencyNs = _loadLatencyNs.load(std::memory_order_relaxed);
+    snapshot.readAheadStride = _readAheadStride.load(std::memory_order_relaxed);
+    snapshot.readAheadStalls = _readAheadStalls.load(std::memory_order_relaxed);
+    copy(_readLatency, snapshot.readLatency);
+    copy(_seekLatency, snapshot.seekLatency);
+    return snapshot;
+}
+
+void MdkIoStats::setEventListener(MDK_NS::MediaEventListener listener)
+{
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    if (listener) {
+        eventListener = std::make_shared<const MDK_NS::MediaEventListener>(std::move(listener));
+    } else {
+        eventListener.reset();
+    }
+}
+
+void MdkIoStats::sendEvent(const std::string &source) const
+{
+    std::shared_ptr<const MDK_NS::MediaEventListener> listener;
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        listener = eventListener;
+    }
+    if (!listener) {
+        return;
+    }
+
+    MDK_NS::MediaEvent event;
+    event.category = EVENT_CATEGORY;
+    event.detail = source + " " + snapshot().toString() + " " + MdkBlockArena::instance().stats().toString();
+    (*listener)(event);
+}
+
+size_t MdkIoStats::bucket(int64_t nanoseconds)
+{
+    uint64_t microseconds = nanoseconds > 0 ? static_cast<uint64_t>(nanoseconds) / 1000 : 0;
+    size_t bucket = 0;
+    while (microseconds != 0 && bucket < LATENCY_BUCKETS - 1) {
+        microseconds >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void MdkIoStats::copy(const AtomicHistogram &from, Histogram &to)
+{
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        to.counts[i] = from[i].load(std::memory_order_relaxed);
+    }
+}
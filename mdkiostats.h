@@ -0,0 +1,145 @@
+#ifndef MDKIOSTATS_H
+#define MDKIOSTATS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "global.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/**
+ * Per-instance I/O counters and latency histograms for a MediaIO.
+ *
+ * Recording is lock-free and meant to be done from a single thread, the one
+ * calling read() and seek(). snapshot() can be taken from any thread while
+ * recording goes on; the counters in it are each exact, but not necessarily
+ * from the same instant.
+ */
+class MdkIoStats
+{
+public:
+    /** Bucket i counts latencies below 2^i microseconds, and at least 2^(i-1) for i > 0 */
+    static constexpr size_t LATENCY_BUCKETS = 24;
+    /** Category of the MediaEvents sent by sendEvent() */
+    static constexpr char const * EVENT_CATEGORY = "io.stats";
+
+    struct Histogram {
+        std::array<uint64_t, LATENCY_BUCKETS> counts{};
+
+        uint64_t total() const;
+        /** Upper bound in microseconds of the bucket holding the given fraction of samples */
+        int64_t percentileUs(double fraction) const;
+    };
+
+    struct Snapshot {
+        uint64_t bytesRead = 0;
+        uint64_t readCalls = 0;
+        /** Reads passed on to the file, fewer than readCalls when small reads are staged */
+        uint64_t fileReads = 0;
+        /** Reads returning less than requested, including at the end of the file */
+        uint64_t shortReads = 0;
+        uint64_t readErrors = 0;
+        uint64_t seeks = 0;
+        /** Sum of the absolute distances of all seeks in bytes */
+        uint64_t seekDistance = 0;
+        /** Bytes read ahead of time when the file was opened, and how long that took */
+        uint64_t prefetchedBytes = 0;
+        uint64_t prefetchNs = 0;
+        /** Reads served from the prefetched data, each saving a seek and read on the file */
+        uint64_t prefetchHits = 0;
+        uint64_t prefetchHitBytes = 0;
+        /** Time spent in the reads passed on to the file that the prefetched data didn't serve */
+        uint64_t fileReadNs = 0;
+        /** Read-ahead window in bytes, read rate in bytes per second and block load time, when reading ahead */
+        uint64_t readAheadDepth = 0;
+        uint64_t readRate = 0;
+        uint64_t loadLatencyNs = 0;
+        /** Stride of the seeks being prefetched along, negative backwards, and reads that waited for a block */
+        int64_t readAheadStride = 0;
+        uint64_t readAheadStalls = 0;
+        Histogram readLatency;
+        Histogram seekLatency;
+
+        /**
+         * Estimated time the prefetch saved, negative if it cost more: the
+         * prefetch hits at the average time of the other file reads, less
+         * the time the prefetch took
+         */
+        int64_t prefetchSavedNs() const;
+
+        /** Compact key=value form, as used in the detail of stats events */
+        std::string toString() const;
+    };
+
+    void recordRead(int64_t requested, int64_t result, int64_t nanoseconds);
+    void recordFileRead();
+    /** Time of a file read not served from the prefetched data */
+    void recordFileReadTime(int64_t nanoseconds);
+    void recordSeek(int64_t from, int64_t to, int64_t nanoseconds);
+    void recordPrefetch(int64_t bytes, int64_t nanoseconds);
+    void recordPrefetchHit(int64_t bytes);
+    /** Set the current read-ahead state, these are not accumulated */
+    void recordReadAhead(int64_t depth, int64_t readRate, int64_t loadLatencyNs, int64_t stride, int64_t stalls);
+
+    Snapshot snapshot() const;
+
+    /**
+     * Set the listener that receives "io.stats" events from all instances,
+     * for example one forwarding to the Player's event listener. Pass
+     * nullptr to stop receiving them.
+     */
+    static void setEventListener(MDK_NS::MediaEventListener listener);
+
+    /**
+     * Send a snapshot to the event listener, with detail prefixed by source
+     * and followed by the process-wide MdkBlockArena stats
+     */
+    void sendEvent(const std::string &source) const;
+
+private:
+    using Counter = std::atomic<uint64_t>;
+    using AtomicHistogram = std::array<Counter, LATENCY_BUCKETS>;
+
+    /** Single writer, so a plain load and store is enough and avoids locked instructions */
+    static void add(Counter &counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+    static size_t bucket(int64_t nanoseconds);
+    static void copy(const AtomicHistogram &from, Histogram &to);
+
+    Counter _bytesRead{0};
+    Counter _readCalls{0};
+    Counter _fileReads{0};
+    Counter _shortReads{0};
+    Counter _readErrors{0};
+    Counter _seeks{0};
+    Counter _seekDistance{0};
+    Counter _prefetchedBytes{0};
+    Counter _prefetchNs{0};
+    Counter _prefetchHits{0};
+    Counter _prefetchHitBytes{0};
+    Counter _fileReadNs{0};
+    Counter _readAheadDepth{0};
+    Counter _readRate{0};
+    Counter _loadLatencyNs{0};
+    std::atomic<int64_t> _readAheadStride{0};
+    Counter _readAheadStalls{0};
+    AtomicHistogram _readLatency{};
+    AtomicHistogram _seekLatency{};
+};
+
+#endif // MDKIOSTATS_H
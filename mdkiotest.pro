@@ -15,25 +15,11 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
-        main.cpp \
-        mdklocalfileio.cpp \
-        mdksupport.cpp
+        main.cpp
 
-HEADERS += \
-        mdklocalfileio.h \
-        mdksupport.h
+include(mdkio.pri)
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
-
-win32 {
-# MDK (Media Development Kit)
-MDK_DIR = D:\Development\mdk-sdk
-INCLUDEPATH += $$MDK_DIR/include
-LIBS += $$MDK_DIR/lib/x64/mdk.lib
-} 
-macx {
-LIBS += -framework mdk
-}
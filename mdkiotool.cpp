@@ -0,0 +1,63 @@
+#include "mdkiotool.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#if defined Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace {
+
+constexpr int64_t MB = 1024 * 1024;
+
+}
+
+bool generate(const QString &fileName, int64_t size)
+{
+    const QFileInfo info(fileName);
+    if (info.exists() && info.size() == size) {
+        return true;
+    }
+
+    std::printf("Generating %lld MB in %s\n", static_cast<long long>(size / MB), qPrintable(fileName));
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    std::mt19937_64 random(size);
+    std::vector<uint64_t> chunk(static_cast<size_t>(4 * MB / sizeof(uint64_t)));
+    for (int64_t written = 0; written < size;) {
+        std::generate(chunk.begin(), chunk.end(), std::ref(random));
+        const int64_t length = qMin<int64_t>(size - written, 4 * MB);
+        if (file.write(reinterpret_cast<const char*>(chunk.data()), length) != length) {
+            return false;
+        }
+        written += length;
+    }
+    return true;
+}
+
+void dropCache(const QString &fileName)
+{
+#if defined Q_OS_LINUX
+    QFile file(fileName);
+    if (file.open(QFile::ReadOnly)) {
+        posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+    }
+#else
+    Q_UNUSED(fileName)
+#endif
+}
+
+int64_t percentile(const std::vector<int64_t> &sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    const size_t index = qMin(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())));
+    return sorted[index];
+}
@@ -0,0 +1,21 @@
+#ifndef MDKIOTOOL_H
+#define MDKIOTOOL_H
+
+#include <cstdint>
+#include <vector>
+#include <QtCore/QString>
+
+/*
+ * Helpers shared by the command line tools, mdkiobench and mdkioreplay.
+ */
+
+/** Generate a file of size bytes of random data, unless it already has that size */
+bool generate(const QString &fileName, int64_t size);
+
+/** Drop the file from the page cache, so every run starts cold */
+void dropCache(const QString &fileName);
+
+/** Value at fraction of sorted, 0 if it is empty */
+int64_t percentile(const std::vector<int64_t> &sorted, double fraction);
+
+#endif // MDKIOTOOL_H
@@ -0,0 +1,202 @@
+#include "mdkiotrace.h"
+#include "mdktrace.h"
+#include <cstring>
+
+namespace {
+
+/** Trace header: magic and the size of the file, 8 bytes */
+const char MAGIC[8] = {'M', 'D', 'K', 'I', 'O', 'T', 'R', '1'};
+constexpr int HEADER_SIZE = 16;
+
+/** Reads the varints of a loaded trace, failing at the end of the data */
+class Decoder
+{
+public:
+    Decoder(const uint8_t *data, size_t size):
+        _data(data),
+        _end(data + size)
+    {
+        // empty
+    }
+
+    bool atEnd() const { return _data == _end; }
+
+    bool byte(uint8_t &value)
+    {
+        if (_data == _end) {
+            return false;
+        }
+        value = *_data++;
+        return true;
+    }
+
+    bool unsignedValue(uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t next = 0;
+            if (!byte(next)) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(next & 0x7f) << shift;
+            if (!(next & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool signedValue(int64_t &value)
+    {
+        uint64_t encoded = 0;
+        if (!unsignedValue(encoded)) {
+            return false;
+        }
+        value = static_cast<int64_t>(encoded >> 1) ^ -static_cast<int64_t>(encoded & 1);
+        return true;
+    }
+
+private:
+    const uint8_t *_data;
+    const uint8_t *_end;
+};
+
+}
+
+bool MdkIoTrace::load(const QString &fileName, int64_t &fileSize, std::vector<Entry> &entries)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < HEADER_SIZE || std::memcmp(data.constData(), MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    const auto *bytes = reinterpret_cast<const uint8_t*>(data.constData());
+    uint64_t size = 0;
+    for (int i = 15; i >= 8; --i) {
+        size = (size << 8) | bytes[i];
+    }
+    fileSize = static_cast<int64_t>(size);
+
+    entries.clear();
+    Decoder decoder(bytes + HEADER_SIZE, static_cast<size_t>(data.size() - HEADER_SIZE));
+    int64_t time = 0;
+    while (!decoder.atEnd()) {
+        Entry entry;
+        uint8_t call = 0;
+        uint64_t delta = 0;
+        if (!decoder.byte(call) || !decoder.unsignedValue(delta)) {
+            return false;
+        }
+        time += static_cast<int64_t>(delta);
+        entry.call = static_cast<Call>(call);
+        entry.time = time;
+
+        bool ok = false;
+        switch (entry.call) {
+        case Call::Read: {
+            uint64_t requested = 0;
+            ok = decoder.unsignedValue(requested) && decoder.signedValue(entry.result);
+            entry.argument = static_cast<int64_t>(requested);
+            break;
+        }
+        case Call::Seek: {
+            uint8_t whence = 0;
+            uint8_t result = 0;
+            ok = decoder.signedValue(entry.argument) && decoder.byte(whence) && decoder.byte(result);
+            entry.whence = whence;
+            entry.result = result;
+            break;
+        }
+        case Call::Size:
+        case Call::Position:
+            ok = decoder.signedValue(entry.result);
+            break;
+        }
+        if (!ok) {
+            // Unknown call or cut off, as when recording was killed
+            return !entries.empty();
+        }
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+MdkIoTrace::~MdkIoTrace()
+{
+    flush();
+}
+
+bool MdkIoTrace::start(const QString &fileName, int64_t fileSize)
+{
+    _file.setFileName(fileName);
+    if (!_file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    _buffer.assign(MAGIC, MAGIC + sizeof(MAGIC));
+    for (int i = 0; i < 8; ++i) {
+        _buffer.push_back(static_cast<uint8_t>((static_cast<uint64_t>(fileSize) >> (8 * i)) & 0xff));
+    }
+    _buffer.reserve(FLUSH_SIZE + 32);
+    _last = MdkTrace::now();
+    return true;
+}
+
+void MdkIoTrace::record(Call call, int64_t argument, int whence, int64_t result)
+{
+    if (!_file.isOpen()) {
+        return;
+    }
+
+    const int64_t now = MdkTrace::now();
+    _buffer.push_back(static_cast<uint8_t>(call));
+    append(static_cast<uint64_t>(now - _last));
+    _last = now;
+    switch (call) {
+    case Call::Read:
+        append(static_cast<uint64_t>(argument));
+        appendSigned(result);
+        break;
+    case Call::Seek:
+        appendSigned(argument);
+        _buffer.push_back(static_cast<uint8_t>(whence));
+        _buffer.push_back(result ? 1 : 0);
+        break;
+    case Call::Size:
+    case Call::Position:
+        appendSigned(result);
+        break;
+    }
+
+    if (_buffer.size() >= FLUSH_SIZE) {
+        flush();
+    }
+}
+
+void MdkIoTrace::append(uint64_t value)
+{
+    while (value >= 0x80) {
+        _buffer.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    _buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void MdkIoTrace::appendSigned(int64_t value)
+{
+    append((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void MdkIoTrace::flush()
+{
+    if (!_file.isOpen() || _buffer.empty()) {
+        return;
+    }
+    if (_file.write(reinterpret_cast<const char*>(_buffer.data()), static_cast<qint64>(_buffer.size())) != static_cast<qint64>(_buffer.size())) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to write trace %s, stopped recording", qPrintable(_file.fileName()));
+        _file.close();
+    }
+    _buffer.clear();
+}
@@ -0,0 +1,73 @@
+#ifndef MDKIOTRACE_H
+#define MDKIOTRACE_H
+
+#include <cstdint>
+#include <vector>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+/**
+ * Compact binary record of the calls made on a MediaIO, to replay them
+ * later with mdkioreplay against any MediaIO and file of the same size.
+ *
+ * The trace starts with "MDKIOTR1" and the size of the file, 8 bytes little
+ * endian. Every call follows as a byte for the Call and LEB128 varints:
+ * the nanoseconds since the previous call, then for Read the size asked
+ * for and the result, for Seek the offset, a byte for whence and a byte
+ * for the result, and for Size and Position the result. Signed values are
+ * zigzag encoded, so a typical call takes 6 to 10 bytes.
+ *
+ * Recording buffers FLUSH_SIZE bytes before writing, from the thread
+ * making the calls.
+ */
+class MdkIoTrace
+{
+public:
+    /** Recorded calls are written out in pieces of this size */
+    static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+    enum class Call : uint8_t {
+        Read = 1,
+        Seek,
+        Size,
+        Position
+    };
+
+    struct Entry {
+        Call call = Call::Read;
+        /** Nanoseconds since recording started */
+        int64_t time = 0;
+        /** Size asked for by Read, offset of Seek */
+        int64_t argument = 0;
+        /** SEEK_SET, SEEK_CUR or SEEK_END for Seek */
+        int whence = 0;
+        /** Bytes read, 1 for a successful Seek and 0 for a failed one, size or position */
+        int64_t result = 0;
+    };
+
+    /** Read a whole trace. Returns false if it can't be read or is not a trace. */
+    static bool load(const QString &fileName, int64_t &fileSize, std::vector<Entry> &entries);
+
+    MdkIoTrace() = default;
+    /** Writes what is buffered */
+    ~MdkIoTrace();
+
+    MdkIoTrace(const MdkIoTrace &) = delete;
+    MdkIoTrace &operator=(const MdkIoTrace &) = delete;
+
+    /** Start recording the calls on a file of fileSize bytes into fileName */
+    bool start(const QString &fileName, int64_t fileSize);
+
+    void record(Call call, int64_t argument, int whence, int64_t result);
+
+private:
+    void append(uint64_t value);
+    void appendSigned(int64_t value);
+    void flush();
+
+    QFile _file;
+    std::vector<uint8_t> _buffer;
+    int64_t _last = 0;
+};
+
+#endif // MDKIOTRACE_H
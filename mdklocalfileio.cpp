@@ -1,6 +1,37 @@
 #include "mdklocalfileio.h"
-#include <QtCore/QtDebug>
+#include "mdkpreloader.h"
+#include "mdktrace.h"
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFileInfo>
 #include <QtCore/QUrl>
+#include <QtCore/QUrlQuery>
+#include <cstring>
+
+namespace {
+
+/**
+ * Value of an option: the url query item if present, otherwise the MDK
+ * global option "MdkLocalFileIO.<key>". Empty if neither is set.
+ */
+QString option(const QUrlQuery &query, const char *key)
+{
+    if (query.hasQueryItem(key)) {
+        return query.queryItemValue(key);
+    }
+
+    const MDK_NS::OptionVal value = MDK_NS::GetGlobalOption((std::string(MdkLocalFileIO::NAME) + "." + key).c_str());
+    if (const auto *text = std::get_if<std::string>(&value)) {
+        return QString::fromStdString(*text);
+    } else if (const auto *number = std::get_if<int>(&value)) {
+        return QString::number(*number);
+    } else if (const auto *number = std::get_if<int64_t>(&value)) {
+        return QString::number(*number);
+    }
+    return QString();
+}
+
+}
 
 MdkLocalFileIO::MdkLocalFileIO():
     mdk::MediaIO()
@@ -10,7 +41,7 @@ MdkLocalFileIO::MdkLocalFileIO():
 
 void MdkLocalFileIO::registerOnce()
 {
-    qDebug() << "Registering MdkLocalFileIO";
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkLocalFileIO");
     MediaIO::registerOnce(NAME, []{ return new MdkLocalFileIO();});
 }
 
@@ -20,52 +51,231 @@ const char *MdkLocalFileIO::name() const
 }
 
 const std::set<std::string> &MdkLocalFileIO::protocols() const {
-    qDebug() << "Localfiles protocols requested";
+    MDKIO_TRACE(MDK_NS::Debug, "Localfiles protocols requested");
     static const std::set<std::string> s{PROTOCOL};
     return s;
 }
 
 int64_t MdkLocalFileIO::read(uint8_t *data, int64_t maxSize)
 {
-    if (!_videoFile || !_videoFile->isOpen()) {
+    if (!isFileOpen()) {
         return 0;
     }
-    return _videoFile->read(reinterpret_cast<char*>(data), maxSize);
+
+    MDKIO_TRACE_SPAN(span, "read");
+    QElapsedTimer timer;
+    timer.start();
+    const int64_t position = _seekIndex ? readPosition() : 0;
+    const int64_t bytesRead = _staging ? readStaged(data, maxSize) : readFile(data, maxSize);
+    _stats.recordRead(maxSize, bytesRead, timer.nsecsElapsed());
+    if (_recorder) {
+        _recorder->record(MdkIoTrace::Call::Read, maxSize, 0, bytesRead);
+    }
+    if (_seekIndex) {
+        _seekIndex->recordRead(position, bytesRead);
+    }
+    MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+
+    if (_statsInterval > 0 && _statsTimer.elapsed() >= _statsInterval) {
+        _statsTimer.restart();
+        updateReadAheadStats();
+        _stats.sendEvent(url());
+    }
+    return bytesRead;
 }
 
 bool MdkLocalFileIO::seek(int64_t offset, int from)
 {
-    if (!_videoFile || !_videoFile->isOpen()) {
+    if (!isFileOpen()) {
         return false;
     }
 
+    MDKIO_TRACE_SPAN(span, "seek");
+    const int64_t previous = readPosition();
     qint64 position = offset;
     if (from == SEEK_CUR) {
-        position += _videoFile->pos();
+        position += previous;
     } else if (from == SEEK_END) {
-        position += size();
+        position += fileSize();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    bool sought = true;
+    if (_staging && _staging->covers(position)) {
+        // Read from the staging buffer, the file stays where it is
+        _stagedPosition = position;
+    } else {
+        sought = seekFile(position);
+        if (sought && _staging) {
+            _stagedPosition = position;
+        }
+    }
+    MDKIO_TRACE_SPAN_VALUE(span, position);
+    if (_recorder) {
+        _recorder->record(MdkIoTrace::Call::Seek, offset, from, sought);
+    }
+    if (sought) {
+        _stats.recordSeek(previous, position, timer.nsecsElapsed());
+        if (_seekIndex) {
+            _seekIndex->recordSeek(position);
+        }
+    }
+    return sought;
+}
+
+int64_t MdkLocalFileIO::readFile(uint8_t *data, int64_t maxSize)
+{
+    _stats.recordFileRead();
+    if (_prefetch) {
+        const int64_t bytesRead = readPrefetched(data, maxSize);
+        if (bytesRead > 0) {
+            return bytesRead;
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const int64_t bytesRead = readMode(data, maxSize);
+    _stats.recordFileReadTime(timer.nsecsElapsed());
+    return bytesRead;
+}
+
+int64_t MdkLocalFileIO::readMode(uint8_t *data, int64_t maxSize)
+{
+    switch (_mode) {
+    case Mode::Buffered:
+        return _videoFile->read(reinterpret_cast<char*>(data), maxSize);
+    case Mode::Mapped:
+        return readMapped(data, maxSize);
+    case Mode::ReadAhead: {
+        const int64_t bytesRead = _readAhead->read(_position, data, maxSize);
+        if (bytesRead > 0) {
+            _position += bytesRead;
+        }
+        return bytesRead;
+    }
+    case Mode::Stream: {
+        const int64_t bytesRead = _stream->read(_position, data, maxSize);
+        if (bytesRead > 0) {
+            _position += bytesRead;
+        }
+        return bytesRead;
+    }
+    case Mode::Direct: {
+        const int64_t bytesRead = _direct->read(_position, data, maxSize);
+        if (bytesRead > 0) {
+            _position += bytesRead;
+        }
+        return bytesRead;
+    }
+    case Mode::Cached:
+        return readCached(data, maxSize);
+    case Mode::Shared: {
+        if (_cache) {
+            return readCached(data, maxSize);
+        }
+        const int64_t bytesRead = _shared->read(_position, data, maxSize);
+        if (bytesRead > 0) {
+            _position += bytesRead;
+        }
+        return bytesRead;
     }
-    return _videoFile->seek(position);
+    }
+    return 0;
+}
+
+bool MdkLocalFileIO::seekFile(int64_t position)
+{
+    if (_mode == Mode::Buffered) {
+        return _videoFile->seek(position);
+    }
+
+    if (position < 0 || position > fileSize()) {
+        return false;
+    }
+    _position = position;
+    if (_cache) {
+        _cache->noteSeek(position);
+    }
+    if (_readAhead) {
+        _readAhead->seek(position);
+    }
+    if (_stream) {
+        _stream->seek(position);
+    }
+    return true;
 }
 
 int64_t MdkLocalFileIO::position() const
 {
-    if (!_videoFile || !_videoFile->isOpen()) {
+    const int64_t position = readPosition();
+    if (_recorder) {
+        _recorder->record(MdkIoTrace::Call::Position, 0, 0, position);
+    }
+    return position;
+}
+
+int64_t MdkLocalFileIO::readPosition() const
+{
+    if (!isFileOpen()) {
         return 0;
     }
-    return _videoFile->pos();
+    return _staging ? _stagedPosition : filePosition();
+}
+
+int64_t MdkLocalFileIO::filePosition() const
+{
+    return (_mode == Mode::Buffered) ? _videoFile->pos() : _position;
 }
 
 int64_t MdkLocalFileIO::size() const
 {
+    const int64_t bytes = fileSize();
+    if (_recorder) {
+        _recorder->record(MdkIoTrace::Call::Size, 0, 0, bytes);
+    }
+    return bytes;
+}
+
+int64_t MdkLocalFileIO::fileSize() const
+{
+    if (_shared) {
+        return _shared->size();
+    }
     if (!_videoFile || !_videoFile->isOpen()) {
         return 0;
     }
     return _videoFile->size();
 }
 
+bool MdkLocalFileIO::isFileOpen() const
+{
+    return _shared || (_videoFile && _videoFile->isOpen());
+}
+
 bool MdkLocalFileIO::onUrlChanged()
 {
+    MDKIO_TRACE_SPAN(span, "open");
+
+    // The mapping refers to the file, so it has to go first
+    _mapping.reset();
+    _readAhead.reset();
+    _stream.reset();
+    _direct.reset();
+    _cache.reset();
+    _diskFile.reset();
+    _prefetch.reset();
+    // Saves what was recorded for the previous file
+    _seekIndex.reset();
+    _recorder.reset();
+    _staging.reset();
+    _shared.reset();
+    _position = 0;
+    _stagedPosition = 0;
+    _statsInterval = 0;
+    _mode = Mode::Buffered;
+
     if (_videoFile != nullptr) {
         _videoFile->close();
         _videoFile.reset();
@@ -77,14 +287,330 @@ bool MdkLocalFileIO::onUrlChanged()
     QUrl protocolUrl(QUrl(QString::fromStdString(url())));
     protocolUrl.setScheme("file");
 
-    _videoFile = std::make_unique<QFile>(protocolUrl.toLocalFile());
+    const QString fileName = protocolUrl.toLocalFile();
+    const QUrlQuery query(protocolUrl);
+    const QString ioMode = option(query, "io");
+    const QString cacheOption = option(query, "cache");
+    int64_t cacheBudget = 0;
+    if (!cacheOption.isEmpty() && ioMode != "mmap" && ioMode != "direct") {
+        bool ok = false;
+        int64_t cacheMB = cacheOption.toLongLong(&ok);
+        if (!ok || cacheMB <= 0) {
+            cacheMB = DEFAULT_CACHE_MB;
+        }
+        cacheBudget = cacheMB * 1024 * 1024;
+    }
+    const QString diskOption = option(query, "disk");
+    const bool useDisk = !diskOption.isEmpty() && ioMode != "mmap" && ioMode != "direct" && ioMode != "stream";
+    if (useDisk && cacheBudget == 0) {
+        // Cached mode reads in blocks, which the disk cache is filled with
+        cacheBudget = DEFAULT_CACHE_MB * 1024 * 1024;
+    }
+    _statsInterval = qMax<int64_t>(0, option(query, "stats").toLongLong());
+    _statsTimer.start();
 
-    qDebug() << "Localfile: Opening" << _videoFile->fileName();
+    MDKIO_TRACE(MDK_NS::Info, "Localfile: Opening %s", qPrintable(fileName));
+    const QString recordOption = option(query, "record");
+    if (!recordOption.isEmpty()) {
+        const QFileInfo info(fileName);
+        const QString traceName = QDir(recordOption).filePath(info.fileName() + ".mdkiotrace");
+        _recorder = std::make_unique<MdkIoTrace>();
+        if (!QDir().mkpath(recordOption) || !_recorder->start(traceName, info.size())) {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to record to %s", qPrintable(traceName));
+            _recorder.reset();
+        }
+    }
+    if (useDisk) {
+        const QString diskSizeOption = option(query, "disksize");
+        const int64_t diskMB = diskSizeOption.isEmpty() ? DEFAULT_DISK_CACHE_MB : diskSizeOption.toLongLong();
+        if (std::shared_ptr<MdkDiskCache> diskCache = MdkDiskCache::open(diskOption, diskMB * 1024 * 1024)) {
+            _diskFile = diskCache->file(fileName);
+        }
+        if (_diskFile) {
+            MDKIO_TRACE(MDK_NS::Debug, "Disk cache holds %lld bytes of %s",
+                        static_cast<long long>(_diskFile->cachedBytes()), qPrintable(fileName));
+        } else {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to use disk cache %s for %s", qPrintable(diskOption), qPrintable(fileName));
+        }
+    }
+    const int64_t stagingKB = option(query, "staging").toLongLong();
+    if (stagingKB > 0) {
+        _staging = std::make_unique<MdkStagingBuffer>(stagingKB * 1024);
+    }
+    if (ioMode == "shared") {
+        _shared = MdkSharedFile::open(fileName);
+        if (_shared) {
+            _mode = Mode::Shared;
+            if (cacheBudget > 0) {
+                _cache = _shared->cache(cacheBudget, MdkReadAhead::BLOCK_SIZE);
+            }
+            return true;
+        }
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to share %s, falling back to buffered reads", qPrintable(fileName));
+    }
+
+    _videoFile = std::make_unique<QFile>(fileName);
     if (!_videoFile->open(QFile::ReadOnly)) {
-        qDebug() << "Unable to open" << _videoFile->fileName();
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to open %s", qPrintable(fileName));
         _videoFile.reset();
         return false;
     }
 
+    if (cacheBudget > 0) {
+        _cache = std::make_shared<MdkBlockCache>(cacheBudget, MdkReadAhead::BLOCK_SIZE);
+    }
+
+    // Take over what preloadUrl() read, its cache only if there is no cache of our own
+    std::unique_ptr<MdkPreloader::State> preloaded = MdkPreloader::instance().take(fileName);
+    if (preloaded) {
+        MDKIO_TRACE(MDK_NS::Debug, "Using preloaded data for %s", qPrintable(fileName));
+        if (!_cache && ioMode != "mmap" && ioMode != "direct") {
+            _cache = std::move(preloaded->cache);
+        }
+    }
+
+    if (ioMode == "mmap") {
+        _mapping = std::make_unique<MdkFileMapping>(*_videoFile);
+        if (_mapping->map()) {
+            _mode = Mode::Mapped;
+            // Reading the mapping is no more than a copy already
+            _staging.reset();
+        } else {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to map %s, falling back to buffered reads", qPrintable(_videoFile->fileName()));
+            _mapping.reset();
+        }
+    } else if (ioMode == "readahead" || ioMode == "parallel") {
+        _readAhead = std::make_unique<MdkReadAhead>(_videoFile->fileName(), bufferSize());
+        _readAhead->setCache(_cache);
+        _readAhead->setDiskCache(_diskFile);
+        const bool parallel = (ioMode == "parallel");
+        const QString threadsOption = option(query, "threads");
+        const QString chunkOption = option(query, "chunk");
+        const int threads = !threadsOption.isEmpty() ? threadsOption.toInt() : (parallel ? DEFAULT_PARALLEL_THREADS : 1);
+        const int64_t chunkKB = !chunkOption.isEmpty() ? chunkOption.toLongLong()
+                                                       : (parallel ? DEFAULT_PARALLEL_CHUNK_KB : MdkReadAhead::BLOCK_SIZE / 1024);
+        _readAhead->setParallel(threads, chunkKB * 1024);
+        const QString bufferOption = option(query, "buffer");
+        const int64_t bufferMs = bufferOption.isEmpty() ? DEFAULT_BUFFER_MS : bufferOption.toLongLong();
+        if (bufferMs > 0) {
+            const QString maxBufferOption = option(query, "maxbuffer");
+            const int64_t maxBufferMB = maxBufferOption.isEmpty() ? DEFAULT_MAX_BUFFER_MB : maxBufferOption.toLongLong();
+            _readAhead->setAdaptive(bufferMs, maxBufferMB * 1024 * 1024);
+        }
+        if (_readAhead->start()) {
+            _mode = Mode::ReadAhead;
+        } else {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to start read-ahead for %s, falling back to buffered reads", qPrintable(_videoFile->fileName()));
+            _readAhead.reset();
+        }
+    } else if (ioMode == "stream") {
+        _stream = std::make_unique<MdkStreamReader>(_videoFile->fileName(), bufferSize());
+        if (_stream->start()) {
+            _mode = Mode::Stream;
+        } else {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to start streaming %s, falling back to buffered reads", qPrintable(_videoFile->fileName()));
+            _stream.reset();
+        }
+    } else if (ioMode == "direct") {
+        _direct = std::make_unique<MdkDirectFile>();
+        if (_direct->open(_videoFile->fileName())) {
+            _mode = Mode::Direct;
+            if (!_direct->isDirect()) {
+                MDKIO_TRACE(MDK_NS::Info, "O_DIRECT not supported for %s, dropping pages from the cache after reading", qPrintable(_videoFile->fileName()));
+            }
+        } else {
+            MDKIO_TRACE(MDK_NS::Warning, "Unable to open %s for direct I/O, falling back to buffered reads", qPrintable(_videoFile->fileName()));
+            _direct.reset();
+        }
+    }
+    if (_mode == Mode::Buffered && _cache) {
+        _mode = Mode::Cached;
+    }
+
+    const QString indexOption = option(query, "index");
+    if (_mode != Mode::Mapped && !indexOption.isEmpty() && indexOption != "0") {
+        _seekIndex = std::make_unique<MdkSeekIndex>(indexOption == "1" ? MdkSeekIndex::defaultDirectory() : indexOption, fileName);
+        _seekIndex->setMediaData(MdkMp4Prefetch::mediaData(*_videoFile));
+        // Buffered mode reads from the QFile's position
+        _videoFile->seek(0);
+    }
+
+    const QString prefetchOption = option(query, "prefetch");
+    const int64_t prefetchMB = !prefetchOption.isEmpty() ? prefetchOption.toLongLong()
+                                                         : (_seekIndex ? DEFAULT_INDEX_PREFETCH_MB : 0);
+    if (_mode != Mode::Mapped && preloaded && preloaded->prefetch) {
+        _prefetch = std::move(preloaded->prefetch);
+    } else if (_mode != Mode::Mapped && prefetchMB > 0) {
+        prefetch(prefetchMB * 1024 * 1024);
+    }
+
     return true;
 }
+
+MdkIoStats::Snapshot MdkLocalFileIO::stats() const
+{
+    updateReadAheadStats();
+    return _stats.snapshot();
+}
+
+void MdkLocalFileIO::updateReadAheadStats() const
+{
+    // Takes the lock the prefetch threads work under, so not on every read
+    if (_readAhead) {
+        const MdkReadAhead::Status status = _readAhead->status();
+        _stats.recordReadAhead(status.depth, status.readRate, status.loadLatency, status.stride, status.stalls);
+    }
+}
+
+MdkBlockCache::Stats MdkLocalFileIO::cacheStats() const
+{
+    return _cache ? _cache->stats() : MdkBlockCache::Stats();
+}
+
+int64_t MdkLocalFileIO::readMapped(uint8_t *data, int64_t maxSize)
+{
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize) {
+        int64_t available = 0;
+        const uint8_t *mapped = _mapping->data(_position, available);
+        if (mapped == nullptr) {
+            break;
+        }
+        const int64_t chunk = qMin(available, maxSize - bytesRead);
+        std::memcpy(data + bytesRead, mapped, static_cast<size_t>(chunk));
+        bytesRead += chunk;
+        _position += chunk;
+    }
+    return bytesRead;
+}
+
+void MdkLocalFileIO::prefetch(int64_t budget)
+{
+    MDKIO_TRACE_SPAN(span, "prefetch");
+    QElapsedTimer timer;
+    timer.start();
+    _prefetch = std::make_unique<MdkMp4Prefetch>();
+    const bool indexed = _seekIndex && !_seekIndex->extents().empty();
+    const bool loaded = indexed ? _prefetch->loadExtents(*_videoFile, _seekIndex->extents(), budget)
+                                : _prefetch->load(*_videoFile, budget);
+    // Buffered mode reads from the QFile's position
+    _videoFile->seek(0);
+    if (!loaded) {
+        _prefetch.reset();
+        return;
+    }
+
+    _stats.recordPrefetch(_prefetch->size(), timer.nsecsElapsed());
+    MDKIO_TRACE_SPAN_VALUE(span, _prefetch->size());
+    MDKIO_TRACE(MDK_NS::Info, "Prefetched %lld bytes of %s in %d reads in %lld us",
+                static_cast<long long>(_prefetch->size()), indexed ? "indexed ranges" : "MP4 metadata",
+                static_cast<int>(_prefetch->ranges().size()),
+                static_cast<long long>(timer.nsecsElapsed() / 1000));
+}
+
+int64_t MdkLocalFileIO::readPrefetched(uint8_t *data, int64_t maxSize)
+{
+    const int64_t position = filePosition();
+    const int64_t bytesRead = _prefetch->read(position, data, maxSize);
+    if (bytesRead <= 0) {
+        return 0;
+    }
+    if (_mode == Mode::Buffered) {
+        if (!_videoFile->seek(position + bytesRead)) {
+            return -1;
+        }
+    } else {
+        _position += bytesRead;
+    }
+    _stats.recordPrefetchHit(bytesRead);
+    return bytesRead;
+}
+
+int64_t MdkLocalFileIO::readStaged(uint8_t *data, int64_t maxSize)
+{
+    int64_t bytesRead = _staging->read(_stagedPosition, data, maxSize);
+    _stagedPosition += bytesRead;
+    if (bytesRead == maxSize) {
+        return bytesRead;
+    }
+
+    // The file is where the last fill or large read left it
+    if (filePosition() != _stagedPosition && !seekFile(_stagedPosition)) {
+        return bytesRead > 0 ? bytesRead : -1;
+    }
+    const int64_t remaining = maxSize - bytesRead;
+    int64_t result = 0;
+    if (_staging->isSmall(remaining)) {
+        // One read for this and the small reads following it
+        int64_t length = 0;
+        uint8_t *buffer = _staging->prepare(_stagedPosition, length);
+        result = readFile(buffer, length);
+        _staging->loaded(result);
+        if (result > 0) {
+            result = _staging->read(_stagedPosition, data + bytesRead, remaining);
+        }
+    } else {
+        result = readFile(data + bytesRead, remaining);
+    }
+
+    if (result < 0) {
+        return bytesRead > 0 ? bytesRead : result;
+    }
+    _stagedPosition += result;
+    return bytesRead + result;
+}
+
+int64_t MdkLocalFileIO::readCached(uint8_t *data, int64_t maxSize)
+{
+    const int64_t fileEnd = fileSize();
+    const int64_t blockSize = _cache->blockSize();
+
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize && _position < fileEnd) {
+        const int64_t blockOffset = _position - _position % blockSize;
+        MdkBlockCache::Block block = _cache->find(blockOffset);
+        if (!block) {
+            auto loaded = std::make_shared<MdkBlockArena::Data>();
+            const int64_t length = qMin(blockSize, fileEnd - blockOffset);
+            // At the memory limit, make room by evicting, and failing that read past the cache
+            while (!loaded->allocate(static_cast<size_t>(length)) && _cache->evictOne()) {
+                // evicted a block, try again
+            }
+            if (loaded->empty()) {
+                const int64_t chunk = qMin(length - (_position - blockOffset), maxSize - bytesRead);
+                if (!readBlock(_position, data + bytesRead, chunk)) {
+                    return bytesRead > 0 ? bytesRead : -1;
+                }
+                bytesRead += chunk;
+                _position += chunk;
+                continue;
+            }
+            if (!readBlock(blockOffset, loaded->data(), length)) {
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+            _cache->insert(blockOffset, loaded);
+            block = std::move(loaded);
+        }
+
+        const int64_t blockPosition = _position - blockOffset;
+        const int64_t chunk = qMin(static_cast<int64_t>(block->size()) - blockPosition, maxSize - bytesRead);
+        std::memcpy(data + bytesRead, block->data() + blockPosition, static_cast<size_t>(chunk));
+        bytesRead += chunk;
+        _position += chunk;
+    }
+    return bytesRead;
+}
+
+bool MdkLocalFileIO::readBlock(int64_t offset, uint8_t *data, int64_t length)
+{
+    if (_diskFile && _diskFile->read(offset, data, length)) {
+        return true;
+    }
+
+    const bool read = _shared ? _shared->read(offset, data, length) == length
+                              : _videoFile->seek(offset) && _videoFile->read(reinterpret_cast<char*>(data), length) == length;
+    if (read && _diskFile) {
+        _diskFile->write(offset, data, length);
+    }
+    return read;
+}
@@ -2,8 +2,22 @@
 #define MDKLOCALFILEIO_H
 
 #include <set>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 
+#include "mdkblockcache.h"
+#include "mdkdirectfile.h"
+#include "mdkdiskcache.h"
+#include "mdkfilemapping.h"
+#include "mdkiostats.h"
+#include "mdkiotrace.h"
+#include "mdkmp4prefetch.h"
+#include "mdkreadahead.h"
+#include "mdkseekindex.h"
+#include "mdksharedfile.h"
+#include "mdkstagingbuffer.h"
+#include "mdkstreamreader.h"
+
 
 // MediaIO.h and global.h from MDK have some unused parameters. We'll ignore those
 // warnings.
@@ -27,6 +41,96 @@ public:
     static constexpr char const * NAME = "MdkLocalFileIO";
     static constexpr char const * PROTOCOL = "localfile";
 
+    /** Default block cache budget in MB, when "cache" has no valid value */
+    static constexpr int64_t DEFAULT_CACHE_MB = 64;
+    /** Default buffered time in ms kept by the read-ahead, see "buffer" */
+    static constexpr int64_t DEFAULT_BUFFER_MS = 2000;
+    /** Default read-ahead memory ceiling in MB, see "maxbuffer" */
+    static constexpr int64_t DEFAULT_MAX_BUFFER_MB = 128;
+    /** Default budget in MB for prefetching the ranges of the seek index when opening, see "index" */
+    static constexpr int64_t DEFAULT_INDEX_PREFETCH_MB = 8;
+    /** Default number of prefetch threads and chunk size in KB with "io=parallel", see "threads" and "chunk" */
+    static constexpr int DEFAULT_PARALLEL_THREADS = 4;
+    static constexpr int64_t DEFAULT_PARALLEL_CHUNK_KB = 256;
+    /** Default size in MB of the disk cache directory, see "disksize" */
+    static constexpr int64_t DEFAULT_DISK_CACHE_MB = 4096;
+
+    /**
+     * How the file is read. Selected with the "io" query item of the url,
+     * e.g. localfile:///videos/ride.mp4?io=mmap, or for all urls without that
+     * query item with SetGlobalOption("MdkLocalFileIO.io", "mmap"). Other
+     * query items can be set globally in the same way.
+     *
+     * The "cache=<MB>" query item adds a block cache with that budget. Without
+     * "io" this selects Cached mode, with "io=readahead" the prefetcher fills
+     * and reads from the cache. Mapped mode relies on the page cache instead, and
+     * Direct mode is meant to keep video data out of memory altogether.
+     *
+     * With "io=readahead" the window starts at bufferSize() and is then
+     * sized to hold "buffer=<ms>" of data at the measured read rate, up to
+     * "maxbuffer=<MB>". "buffer=0" keeps it fixed at bufferSize().
+     *
+     * "io=parallel" is "io=readahead" with "threads=<n>" prefetch threads,
+     * each loading "chunk=<KB>" at a time, to keep fast drives busy. These
+     * can also be set with "io=readahead", which defaults to a single
+     * thread loading whole blocks.
+     *
+     * "io=stream" prefetches like "io=readahead", but hands blocks to read()
+     * through a lock-free ring and keeps nothing once read, see
+     * MdkStreamReader. It suits plain forward playback best.
+     *
+     * "io=shared" reads with pread through an MdkSharedFile, sharing the
+     * descriptor and, with "cache=<MB>", the block cache with all other
+     * instances reading the same file. The first instance opening the file
+     * sets the cache budget.
+     *
+     * "prefetch=<MB>" reads the MP4/MOV metadata boxes into memory when the
+     * file is opened, within that budget, see MdkMp4Prefetch. It is off by
+     * default, as it reads synchronously while opening and keeps the data
+     * for as long as the file is open. Not used in Mapped and Shared mode.
+     *
+     * "staging=<KB>" serves small reads from a buffer of that size, filled
+     * with one large read, see MdkStagingBuffer, and seeks within it don't
+     * go to the file. It is off by default, as it adds a copy of every read
+     * and only pays off with a demuxer making many small reads. Not used in
+     * Mapped mode.
+     *
+     * "disk=<directory>" keeps a copy of the data read in that directory,
+     * which should be on a fast local drive, see MdkDiskCache, and reads
+     * it from there later. "disksize=<MB>" bounds the directory; the first
+     * url using a directory sets it. Meant for media on network mounts and
+     * slow disks, it applies to Cached, Shared and ReadAhead mode, and
+     * selects Cached mode instead of Buffered.
+     *
+     * "index=<directory>" records the ranges read when opening and seeking
+     * in a sidecar in that directory, see MdkSeekIndex, and with "index=1"
+     * in MdkSeekIndex::defaultDirectory(). When the file is opened again,
+     * those ranges are prefetched instead of the MP4 metadata, within the
+     * "prefetch" budget, DEFAULT_INDEX_PREFETCH_MB unless set. Like that, it
+     * isn't used in Mapped and Shared mode.
+     *
+     * Files queued with preloadUrl() take over the preloaded metadata, and
+     * the preloaded blocks as their cache unless "cache" is set, which
+     * selects Cached mode instead of Buffered.
+     *
+     * "record=<directory>" writes the calls made on the file to a trace named
+     * after it in that directory, for replaying with mdkioreplay, see
+     * MdkIoTrace.
+     *
+     * "stats=<ms>" sends the I/O statistics as an "io.stats" MediaEvent to
+     * the listener set with MdkIoStats::setEventListener() at most every ms
+     * milliseconds, from the reading thread.
+     */
+    enum class Mode {
+        Buffered,   ///< QFile::read(), the default
+        Mapped,     ///< memory mapped, "io=mmap"
+        ReadAhead,  ///< prefetched by background threads, "io=readahead" or "io=parallel"
+        Cached,     ///< read in blocks through the block cache, "cache=<MB>"
+        Direct,     ///< bypassing the page cache, "io=direct"
+        Shared,     ///< positional reads from a descriptor shared between instances, "io=shared"
+        Stream      ///< prefetched by a background thread, handed over lock-free, "io=stream"
+    };
+
     MdkLocalFileIO();
 
     ~MdkLocalFileIO() override = default;
@@ -42,7 +146,10 @@ public:
     /** We don't need or want any writing done */
     bool isWritable() const override { return false; }
 
-    /** Reading from file */
+    /**
+     * Reading from file. In ReadAhead mode the prefetch window starts at
+     * bufferSize() at the time the url is set.
+     */
     int64_t read(uint8_t *data, int64_t maxSize) override;
 
     /** No writing is possible */
@@ -57,10 +164,65 @@ public:
     /** Get the size of the video file */
     int64_t size() const override;
 
+    /** The mode the current file was opened with */
+    Mode mode() const { return _mode; }
+
+    /** Hit rate and eviction counters of the block cache, all zero without a cache */
+    MdkBlockCache::Stats cacheStats() const;
+
+    /**
+     * I/O counters and latencies since creation. Can be called from any
+     * thread, though not while the url is being changed.
+     */
+    MdkIoStats::Snapshot stats() const;
+
 protected:
     bool onUrlChanged() override;
 private:
+    int64_t readFile(uint8_t *data, int64_t maxSize);
+    /** Read from the file in the current mode, past the prefetched data */
+    int64_t readMode(uint8_t *data, int64_t maxSize);
+    bool seekFile(int64_t position);
+    int64_t readMapped(uint8_t *data, int64_t maxSize);
+    int64_t readCached(uint8_t *data, int64_t maxSize);
+    int64_t readPrefetched(uint8_t *data, int64_t maxSize);
+    int64_t readStaged(uint8_t *data, int64_t maxSize);
+    bool readBlock(int64_t offset, uint8_t *data, int64_t length);
+    /** Whether the file of the url is open */
+    bool isFileOpen() const;
+    /** Position of the file, ahead of position() when staging */
+    int64_t filePosition() const;
+    /** position() and size() without recording the call */
+    int64_t readPosition() const;
+    int64_t fileSize() const;
+    void prefetch(int64_t budget);
+    /** Copy the read-ahead state into the stats, only done when they are taken or sent */
+    void updateReadAheadStats() const;
+
     std::unique_ptr<QFile> _videoFile;
+    std::unique_ptr<MdkFileMapping> _mapping;
+    std::unique_ptr<MdkReadAhead> _readAhead;
+    std::unique_ptr<MdkStreamReader> _stream;
+    std::unique_ptr<MdkDirectFile> _direct;
+    std::shared_ptr<MdkBlockCache> _cache;
+    std::shared_ptr<MdkDiskCache::File> _diskFile;
+    std::unique_ptr<MdkMp4Prefetch> _prefetch;
+    std::unique_ptr<MdkSeekIndex> _seekIndex;
+    std::unique_ptr<MdkStagingBuffer> _staging;
+    std::unique_ptr<MdkIoTrace> _recorder;
+    /** Only set in Shared mode, in which _videoFile isn't opened */
+    std::shared_ptr<MdkSharedFile> _shared;
+    Mode _mode = Mode::Buffered;
+    /** Read position, not used in Buffered mode */
+    int64_t _position = 0;
+    /** Read position of the caller when staging */
+    int64_t _stagedPosition = 0;
+
+    /** Mutable for the read-ahead state, which is copied in when the stats are taken */
+    mutable MdkIoStats _stats;
+    /** Interval between stats events in ms, 0 if disabled */
+    int64_t _statsInterval = 0;
+    QElapsedTimer _statsTimer;
 };
 
 #endif // MDKLOCALFILEIO_H
@@ -0,0 +1,165 @@
+#include "mdkmemoryio.h"
+#include "mdktrace.h"
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <QtCore/QResource>
+#include <QtCore/QUrl>
+
+namespace {
+
+/** Buffers set with setBuffer(), shared with the MdkMemoryIO reading them */
+struct Registry {
+    std::mutex mutex;
+    std::map<std::string, MdkMemoryIO::Buffer> buffers;
+};
+
+Registry &registry()
+{
+    static Registry instance;
+    return instance;
+}
+
+}
+
+MdkMemoryIO::MdkMemoryIO():
+    mdk::MediaIO()
+{
+    // empty
+}
+
+void MdkMemoryIO::registerOnce()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkMemoryIO");
+    MediaIO::registerOnce(NAME, []{ return new MdkMemoryIO();});
+}
+
+void MdkMemoryIO::setBuffer(const std::string &name, std::shared_ptr<const void> owner, const uint8_t *data, int64_t size)
+{
+    Registry &shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    Buffer &buffer = shared.buffers[name];
+    buffer.owner = std::move(owner);
+    buffer.data = data;
+    buffer.size = size;
+}
+
+void MdkMemoryIO::setBuffer(const std::string &name, const QByteArray &data)
+{
+    // Shares the data of the QByteArray, which stays alive as long as this copy does
+    auto owner = std::make_shared<const QByteArray>(data);
+    setBuffer(name, owner, reinterpret_cast<const uint8_t*>(owner->constData()), owner->size());
+}
+
+void MdkMemoryIO::removeBuffer(const std::string &name)
+{
+    Registry &shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.buffers.erase(name);
+}
+
+const char *MdkMemoryIO::name() const
+{
+    return NAME;
+}
+
+const std::set<std::string> &MdkMemoryIO::protocols() const {
+    static const std::set<std::string> s{PROTOCOL, RESOURCE_PROTOCOL};
+    return s;
+}
+
+int64_t MdkMemoryIO::read(uint8_t *data, int64_t maxSize)
+{
+    const int64_t length = qMin(maxSize, _buffer.size - _position);
+    if (length <= 0) {
+        return 0;
+    }
+    std::memcpy(data, _buffer.data + _position, static_cast<size_t>(length));
+    _position += length;
+    return length;
+}
+
+bool MdkMemoryIO::seek(int64_t offset, int from)
+{
+    int64_t position = offset;
+    if (from == SEEK_CUR) {
+        position += _position;
+    } else if (from == SEEK_END) {
+        position += _buffer.size;
+    }
+    if (position < 0 || position > _buffer.size) {
+        return false;
+    }
+    _position = position;
+    return true;
+}
+
+int64_t MdkMemoryIO::position() const
+{
+    return _position;
+}
+
+int64_t MdkMemoryIO::size() const
+{
+    return _buffer.size;
+}
+
+bool MdkMemoryIO::findBuffer(const std::string &name, Buffer &buffer)
+{
+    Registry &shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    const auto found = shared.buffers.find(name);
+    if (found == shared.buffers.end()) {
+        return false;
+    }
+    buffer = found->second;
+    return true;
+}
+
+bool MdkMemoryIO::loadResource(const QString &path, Buffer &buffer)
+{
+    const QResource resource(QString(":") + path);
+    if (!resource.isValid()) {
+        return false;
+    }
+
+    if (resource.compressionAlgorithm() == QResource::NoCompression) {
+        // Resource data stays where rcc put it for as long as it is registered
+        buffer.data = resource.data();
+        buffer.size = resource.size();
+    } else {
+        auto owner = std::make_shared<const QByteArray>(resource.uncompressedData());
+        buffer.data = reinterpret_cast<const uint8_t*>(owner->constData());
+        buffer.size = owner->size();
+        buffer.owner = std::move(owner);
+        MDKIO_TRACE(MDK_NS::Debug, "Uncompressed resource %s to %lld bytes",
+                    qPrintable(path), static_cast<long long>(buffer.size));
+    }
+    return true;
+}
+
+bool MdkMemoryIO::onUrlChanged()
+{
+    _buffer = Buffer();
+    _position = 0;
+    if (url().empty()) {
+        return true;
+    }
+
+    const QUrl mediaUrl(QString::fromStdString(url()));
+    bool found = false;
+    if (mediaUrl.scheme() == RESOURCE_PROTOCOL) {
+        found = loadResource(mediaUrl.path(), _buffer);
+    } else {
+        // memory:intro and memory:///intro both name "intro"
+        QString name = mediaUrl.path();
+        while (name.startsWith('/')) {
+            name.remove(0, 1);
+        }
+        found = findBuffer(name.toStdString(), _buffer);
+    }
+    if (!found) {
+        MDKIO_TRACE(MDK_NS::Warning, "No media in memory for %s", url().c_str());
+    }
+    return found;
+}
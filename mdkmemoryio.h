@@ -0,0 +1,100 @@
+#ifndef MDKMEMORYIO_H
+#define MDKMEMORYIO_H
+
+#include <memory>
+#include <set>
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "MediaIO.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/**
+ * MediaIO for media already in memory, for urls like memory:intro, naming
+ * a buffer set with setBuffer(), and qrc:/videos/loop.mp4 for Qt resources.
+ *
+ * read() copies straight from the data, and seeking and size() don't touch
+ * anything else. A buffer is reference counted: removing or replacing it
+ * while it is played keeps the data alive until the MdkMemoryIO reading it
+ * is done.
+ *
+ * Resources are read from the data compiled or registered with rcc without
+ * a copy. rcc only compresses files that shrink well, which media hardly
+ * ever do; a compressed resource is uncompressed once when it is opened.
+ */
+class MdkMemoryIO: public MDK_NS::MediaIO
+{
+public:
+    static constexpr char const * NAME = "MdkMemoryIO";
+    static constexpr char const * PROTOCOL = "memory";
+    static constexpr char const * RESOURCE_PROTOCOL = "qrc";
+
+    MdkMemoryIO();
+
+    ~MdkMemoryIO() override = default;
+
+    static void registerOnce();
+
+    /** Media data, kept alive by owner, which may be null for static data */
+    struct Buffer {
+        std::shared_ptr<const void> owner;
+        const uint8_t *data = nullptr;
+        int64_t size = 0;
+    };
+
+    /**
+     * Make size bytes at data playable as memory:name. owner keeps the data
+     * alive and is released when the buffer is removed and no longer read.
+     */
+    static void setBuffer(const std::string &name, std::shared_ptr<const void> owner, const uint8_t *data, int64_t size);
+    /** Make data playable as memory:name, sharing it rather than copying it */
+    static void setBuffer(const std::string &name, const QByteArray &data);
+    /** Stop serving memory:name, reads in progress keep their data */
+    static void removeBuffer(const std::string &name);
+
+    const char* name() const override;
+
+    const std::set<std::string> &protocols() const override;
+
+    /** Always seekable! */
+    bool isSeekable() const override { return true; }
+    /** We don't need or want any writing done */
+    bool isWritable() const override { return false; }
+
+    /** Copy from memory */
+    int64_t read(uint8_t *data, int64_t maxSize) override;
+
+    /** No writing is possible */
+    int64_t write(const uint8_t *, int64_t) override { return 0; }
+
+    /** Seek in the data */
+    bool seek(int64_t offset, int from = SEEK_SET) override;
+
+    /** Get the current position */
+    int64_t position() const override;
+
+    /** Get the size of the data */
+    int64_t size() const override;
+
+protected:
+    bool onUrlChanged() override;
+private:
+    static bool findBuffer(const std::string &name, Buffer &buffer);
+    static bool loadResource(const QString &path, Buffer &buffer);
+
+    Buffer _buffer;
+    int64_t _position = 0;
+};
+
+#endif // MDKMEMORYIO_H
@@ -0,0 +1,193 @@
+#include "mdkmp4prefetch.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+uint32_t bigEndian32(const uint8_t *data)
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+uint64_t bigEndian64(const uint8_t *data)
+{
+    return (uint64_t(bigEndian32(data)) << 32) | bigEndian32(data + 4);
+}
+
+bool readAt(QFile &file, int64_t offset, uint8_t *data, int64_t size)
+{
+    return file.seek(offset) && file.read(reinterpret_cast<char*>(data), size) == size;
+}
+
+bool isType(const uint8_t *type, const char *name)
+{
+    return std::memcmp(type, name, 4) == 0;
+}
+
+/** Whether a file starting with a box of this type looks like an MP4/MOV */
+bool isFirstBox(const uint8_t *type)
+{
+    for (const char *name: {"ftyp", "styp", "moov", "free", "skip", "wide", "pdin", "mdat"}) {
+        if (isType(type, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Read the header of the box at offset, giving its type, its size and the
+ * size of the header. Returns false if there is no valid box there.
+ */
+bool readBox(QFile &file, int64_t offset, int64_t fileSize, uint8_t *type, int64_t &size, int64_t &headerSize)
+{
+    uint8_t header[16];
+    if (offset + 8 > fileSize || !readAt(file, offset, header, 8)) {
+        return false;
+    }
+    std::memcpy(type, header + 4, 4);
+
+    size = bigEndian32(header);
+    headerSize = 8;
+    if (size == 1) {
+        if (offset + 16 > fileSize || !readAt(file, offset + 8, header + 8, 8)) {
+            return false;
+        }
+        size = static_cast<int64_t>(bigEndian64(header + 8));
+        headerSize = 16;
+    } else if (size == 0) {
+        size = fileSize - offset;
+    }
+    return size >= headerSize && size <= fileSize - offset;
+}
+
+}
+
+bool MdkMp4Prefetch::load(QFile &file, int64_t budget)
+{
+    return loadExtents(file, metadataBoxes(file), budget);
+}
+
+bool MdkMp4Prefetch::loadExtents(QFile &file, std::vector<Extent> extents, int64_t budget)
+{
+    _ranges.clear();
+
+    // Take the extents in the order given while they fit in the budget
+    std::vector<Extent> chosen;
+    int64_t total = 0;
+    for (const Extent &extent: extents) {
+        if (total + extent.size <= budget) {
+            chosen.push_back(extent);
+            total += extent.size;
+        }
+    }
+    std::sort(chosen.begin(), chosen.end(), [](const Extent &a, const Extent &b) { return a.offset < b.offset; });
+
+    // Merge overlapping extents, and nearby ones where the gap between them fits in the budget too
+    std::vector<Extent> merged;
+    for (const Extent &extent: chosen) {
+        if (!merged.empty()) {
+            const int64_t end = merged.back().offset + merged.back().size;
+            const int64_t gap = extent.offset - end;
+            if (gap <= 0 || (gap <= MERGE_GAP && total + gap <= budget)) {
+                merged.back().size = qMax(end, extent.offset + extent.size) - merged.back().offset;
+                total += qMax<int64_t>(gap, 0);
+                continue;
+            }
+        }
+        merged.push_back(extent);
+    }
+
+    for (const Extent &extent: merged) {
+        Range range;
+        range.offset = extent.offset;
+        range.data.resize(static_cast<size_t>(extent.size));
+        if (readAt(file, extent.offset, range.data.data(), extent.size)) {
+            _ranges.push_back(std::move(range));
+        }
+    }
+    return !_ranges.empty();
+}
+
+int64_t MdkMp4Prefetch::read(int64_t position, uint8_t *data, int64_t maxSize) const
+{
+    for (const Range &range: _ranges) {
+        const int64_t end = range.offset + static_cast<int64_t>(range.data.size());
+        if (position >= range.offset && position < end) {
+            const int64_t length = qMin(maxSize, end - position);
+            std::memcpy(data, range.data.data() + (position - range.offset), static_cast<size_t>(length));
+            return length;
+        }
+    }
+    return 0;
+}
+
+int64_t MdkMp4Prefetch::size() const
+{
+    int64_t size = 0;
+    for (const Range &range: _ranges) {
+        size += static_cast<int64_t>(range.data.size());
+    }
+    return size;
+}
+
+std::vector<MdkMp4Prefetch::Extent> MdkMp4Prefetch::metadataBoxes(QFile &file)
+{
+    std::vector<Extent> boxes;
+    const int64_t fileSize = file.size();
+
+    int64_t offset = 0;
+    for (int count = 0; count < MAX_TOP_LEVEL_BOXES; ++count) {
+        uint8_t type[4];
+        int64_t size = 0;
+        int64_t headerSize = 0;
+        if (!readBox(file, offset, fileSize, type, size, headerSize)) {
+            break;
+        }
+        if (count == 0 && !isFirstBox(type)) {
+            return boxes;
+        }
+
+        if (isType(type, "ftyp") || isType(type, "moov") || isType(type, "sidx") || isType(type, "mfra")) {
+            boxes.push_back({offset, size});
+        } else if (isType(type, "moof")) {
+            // Fragments from here on, their index is in the sidx before or the mfra at the end
+            break;
+        }
+        offset += size;
+    }
+
+    // A fragmented file ends with an mfro box holding the size of the mfra box
+    uint8_t mfro[16];
+    if (!boxes.empty() && fileSize >= 16 && readAt(file, fileSize - 16, mfro, 16) &&
+            bigEndian32(mfro) == 16 && isType(mfro + 4, "mfro")) {
+        const int64_t mfraSize = bigEndian32(mfro + 12);
+        const bool known = std::any_of(boxes.begin(), boxes.end(), [&](const Extent &box) {
+            return box.offset == fileSize - mfraSize;
+        });
+        if (mfraSize >= 16 && mfraSize <= fileSize && !known) {
+            boxes.push_back({fileSize - mfraSize, mfraSize});
+        }
+    }
+    return boxes;
+}
+
+MdkMp4Prefetch::Extent MdkMp4Prefetch::mediaData(QFile &file)
+{
+    const int64_t fileSize = file.size();
+
+    int64_t offset = 0;
+    for (int count = 0; count < MAX_TOP_LEVEL_BOXES; ++count) {
+        uint8_t type[4];
+        int64_t size = 0;
+        int64_t headerSize = 0;
+        if (!readBox(file, offset, fileSize, type, size, headerSize) || (count == 0 && !isFirstBox(type))) {
+            break;
+        }
+        if (isType(type, "mdat")) {
+            return {offset + headerSize, size - headerSize};
+        }
+        offset += size;
+    }
+    return {0, 0};
+}
@@ -0,0 +1,77 @@
+#ifndef MDKMP4PREFETCH_H
+#define MDKMP4PREFETCH_H
+
+#include <cstdint>
+#include <vector>
+#include <QtCore/QFile>
+
+/**
+ * Reads the metadata boxes of an MP4/MOV file into memory when it is opened.
+ *
+ * Opening an MP4 makes the demuxer jump between the head of the file and
+ * the moov box, which is often at the end, in many small reads. load()
+ * walks the top-level boxes itself, using only their headers, and reads
+ * ftyp, moov and, for fragmented files, sidx and mfra in one large read
+ * per group of nearby boxes. The demuxer's reads within those ranges are
+ * then served from memory.
+ *
+ * Files that don't start with a known top-level box are left alone.
+ */
+class MdkMp4Prefetch
+{
+public:
+    /** Boxes closer together than this are read as one range */
+    static constexpr int64_t MERGE_GAP = 256 * 1024;
+    /** Top-level boxes walked at most, a fragmented file has a moof/mdat pair per fragment */
+    static constexpr int MAX_TOP_LEVEL_BOXES = 64;
+
+    struct Range {
+        int64_t offset = 0;
+        std::vector<uint8_t> data;
+    };
+
+    struct Extent {
+        int64_t offset;
+        int64_t size;
+    };
+
+    /**
+     * Find and read the metadata boxes of file, reading at most budget
+     * bytes. Leaves the file position undefined. Returns false if nothing
+     * was prefetched.
+     */
+    bool load(QFile &file, int64_t budget);
+
+    /**
+     * Read extents of file, found some other way than by walking the boxes,
+     * such as from an MdkSeekIndex. Extents are taken in the order given,
+     * most wanted first, as long as they fit in the budget, and nearby ones
+     * are merged as in load().
+     */
+    bool loadExtents(QFile &file, std::vector<Extent> extents, int64_t budget);
+
+    /**
+     * Copy the prefetched data at position into data, up to maxSize bytes.
+     * Returns the number of bytes copied, 0 if position isn't prefetched.
+     */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize) const;
+
+    /** Total number of bytes held */
+    int64_t size() const;
+
+    const std::vector<Range> &ranges() const { return _ranges; }
+
+    /**
+     * The payload of the first mdat box of file, where the samples start,
+     * found from the box headers. Empty if file isn't an MP4/MOV or has
+     * none. Leaves the file position undefined.
+     */
+    static Extent mediaData(QFile &file);
+
+private:
+    static std::vector<Extent> metadataBoxes(QFile &file);
+
+    std::vector<Range> _ranges;
+};
+
+#endif // MDKMP4PREFETCH_H
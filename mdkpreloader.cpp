@@ -0,0 +1,179 @@
+#include "mdkpreloader.h"
+#include <algorithm>
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#include "mdkreadahead.h"
+#include "mdktrace.h"
+
+#if defined Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined Q_OS_MAC
+#include <sys/resource.h>
+#elif defined Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+/** Let the reads of the calling thread yield to those of the player */
+void lowerIoPriority()
+{
+#if defined Q_OS_LINUX && defined SYS_ioprio_set
+    const int whoProcess = 1;
+    const int classIdle = 3;
+    const int classShift = 13;
+    syscall(SYS_ioprio_set, whoProcess, 0, classIdle << classShift);
+#elif defined Q_OS_MAC
+    setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#elif defined Q_OS_WIN
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#endif
+}
+
+}
+
+MdkPreloader &MdkPreloader::instance()
+{
+    static MdkPreloader preloader;
+    return preloader;
+}
+
+MdkPreloader::~MdkPreloader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        if (_loading) {
+            _loading->cancelled = true;
+        }
+    }
+    _queued.notify_all();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void MdkPreloader::preload(const QString &fileName, int64_t budget)
+{
+    const QFileInfo info(fileName);
+    const QString path = info.canonicalFilePath();
+    if (path.isEmpty() || budget <= 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    const bool known = std::any_of(_entries.begin(), _entries.end(), [&](const std::shared_ptr<Entry> &entry) {
+        return entry->path == path;
+    });
+    if (known) {
+        return;
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->path = path;
+    entry->budget = budget;
+    entry->size = info.size();
+    entry->modified = info.lastModified().toMSecsSinceEpoch();
+    _entries.push_back(entry);
+    _queue.push_back(entry);
+
+    if (_entries.size() > MAX_PRELOADS) {
+        std::shared_ptr<Entry> oldest = _entries.front();
+        _entries.pop_front();
+        oldest->cancelled = true;
+        _queue.erase(std::remove(_queue.begin(), _queue.end(), oldest), _queue.end());
+    }
+
+    if (!_thread.joinable()) {
+        _thread = std::thread([this]{ run(); });
+    }
+    _queued.notify_one();
+}
+
+std::unique_ptr<MdkPreloader::State> MdkPreloader::take(const QString &fileName)
+{
+    const QFileInfo info(fileName);
+    const QString path = info.canonicalFilePath();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto found = std::find_if(_entries.begin(), _entries.end(), [&](const std::shared_ptr<Entry> &entry) {
+        return entry->path == path;
+    });
+    if (path.isEmpty() || found == _entries.end()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Entry> entry = *found;
+    _entries.erase(found);
+    _queue.erase(std::remove(_queue.begin(), _queue.end(), entry), _queue.end());
+    entry->cancelled = true;
+    _loaded.wait(lock, [&]{ return _loading != entry; });
+
+    if (info.size() != entry->size || info.lastModified().toMSecsSinceEpoch() != entry->modified) {
+        return nullptr;
+    }
+    return std::make_unique<State>(std::move(entry->state));
+}
+
+void MdkPreloader::run()
+{
+    lowerIoPriority();
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _queued.wait(lock, [this]{ return _stop || !_queue.empty(); });
+        if (_stop) {
+            break;
+        }
+
+        std::shared_ptr<Entry> entry = _queue.front();
+        _queue.pop_front();
+        _loading = entry;
+        lock.unlock();
+        load(*entry);
+        lock.lock();
+        _loading.reset();
+        _loaded.notify_all();
+    }
+}
+
+void MdkPreloader::load(Entry &entry)
+{
+    MDKIO_TRACE_SPAN(span, "preload");
+    QFile file(entry.path);
+    if (!file.open(QFile::ReadOnly | QFile::Unbuffered)) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to preload %s", qPrintable(entry.path));
+        return;
+    }
+
+    auto prefetch = std::make_unique<MdkMp4Prefetch>();
+    if (prefetch->load(file, entry.budget)) {
+        entry.state.prefetch = std::move(prefetch);
+    }
+
+    // The rest of the budget goes to the first blocks of the file
+    const int64_t blockSize = MdkReadAhead::BLOCK_SIZE;
+    const int64_t budget = entry.budget - (entry.state.prefetch ? entry.state.prefetch->size() : 0);
+    if (budget < blockSize) {
+        return;
+    }
+    auto cache = std::make_shared<MdkBlockCache>(budget, blockSize);
+    const int64_t fileSize = file.size();
+    int64_t offset = 0;
+    while (offset < fileSize && offset + blockSize <= budget && !entry.cancelled) {
+        auto block = std::make_shared<MdkBlockArena::Data>();
+        const int64_t length = qMin(blockSize, fileSize - offset);
+        if (!block->allocate(static_cast<size_t>(length)) || !file.seek(offset) ||
+                file.read(reinterpret_cast<char*>(block->data()), length) != length) {
+            break;
+        }
+        cache->insert(offset, std::move(block));
+        offset += length;
+    }
+    entry.state.cache = std::move(cache);
+    MDKIO_TRACE_SPAN_VALUE(span, offset);
+    MDKIO_TRACE(MDK_NS::Debug, "Preloaded %lld bytes of %s", static_cast<long long>(offset), qPrintable(entry.path));
+}
@@ -0,0 +1,83 @@
+#ifndef MDKPRELOADER_H
+#define MDKPRELOADER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <QtCore/QString>
+
+#include "mdkblockcache.h"
+#include "mdkmp4prefetch.h"
+
+/**
+ * Warms up files that are about to be played, such as the next segment of
+ * a ride, so that switching to them doesn't start cold.
+ *
+ * preload() queues a file for a single background thread with idle I/O
+ * priority. It reads the MP4 metadata with MdkMp4Prefetch, and then the
+ * start of the file into a block cache, up to the given budget. When
+ * MdkLocalFileIO later opens the same file it takes over that state with
+ * take(), so the demuxer's first reads come from memory.
+ */
+class MdkPreloader
+{
+public:
+    /** Preloaded files not yet taken that are kept, the oldest is dropped first */
+    static constexpr size_t MAX_PRELOADS = 4;
+
+    /** What MdkLocalFileIO takes over. Either part can be null. */
+    struct State {
+        std::unique_ptr<MdkMp4Prefetch> prefetch;
+        std::shared_ptr<MdkBlockCache> cache;
+    };
+
+    static MdkPreloader &instance();
+
+    ~MdkPreloader();
+
+    MdkPreloader(const MdkPreloader &) = delete;
+    MdkPreloader &operator=(const MdkPreloader &) = delete;
+
+    /** Queue fileName to be preloaded with at most budget bytes of memory */
+    void preload(const QString &fileName, int64_t budget);
+
+    /**
+     * Take the preloaded state of fileName, or nullptr if it wasn't
+     * preloaded. A preload still in progress is stopped, and what it read
+     * so far is returned.
+     */
+    std::unique_ptr<State> take(const QString &fileName);
+
+private:
+    struct Entry {
+        QString path;
+        int64_t budget = 0;
+        /** Size and modification time when queued, to detect files replaced before they are opened */
+        int64_t size = 0;
+        int64_t modified = 0;
+        std::atomic<bool> cancelled{false};
+        State state;
+    };
+
+    MdkPreloader() = default;
+    void run();
+    static void load(Entry &entry);
+
+    std::mutex _mutex;
+    std::condition_variable _queued;
+    std::condition_variable _loaded;
+    std::deque<std::shared_ptr<Entry>> _queue;
+    /** Entry being loaded by the thread, take() waits until it is done with it */
+    std::shared_ptr<Entry> _loading;
+    /** Queued and loaded entries by canonical path, in the order they were added */
+    std::deque<std::shared_ptr<Entry>> _entries;
+    bool _stop = false;
+
+    std::thread _thread;
+};
+
+#endif // MDKPRELOADER_H
@@ -0,0 +1,463 @@
+#include "mdkreadahead.h"
+#include "mdktrace.h"
+#include <algorithm>
+#include <cstring>
+
+MdkReadAhead::MdkReadAhead(const QString &fileName, int64_t bufferSize):
+    _fileName(fileName),
+    _blocks(static_cast<size_t>(qMax<int64_t>(MIN_BLOCK_COUNT, bufferSize / BLOCK_SIZE))),
+    _windowBlocks(static_cast<int64_t>(_blocks.size()))
+{
+    // empty
+}
+
+MdkReadAhead::~MdkReadAhead()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _windowMoved.notify_all();
+    for (auto &thread: _threads) {
+        thread.join();
+    }
+}
+
+bool MdkReadAhead::start()
+{
+    for (int i = 0; i < _threadCount; ++i) {
+        auto file = std::make_unique<QFile>(_fileName);
+        if (!file->open(QFile::ReadOnly | QFile::Unbuffered)) {
+            return false;
+        }
+        _files.push_back(std::move(file));
+    }
+    _fileSize = _files.front()->size();
+    _sampleStart = std::chrono::steady_clock::now();
+    _claimed.resize(_blocks.size());
+    updateWindow();
+
+    // Block data is allocated when a block is first loaded
+    for (auto &file: _files) {
+        QFile *threadFile = file.get();
+        _threads.emplace_back([this, threadFile]{ run(*threadFile); });
+    }
+    return true;
+}
+
+int64_t MdkReadAhead::read(int64_t position, uint8_t *data, int64_t maxSize)
+{
+    if (position < 0 || position >= _fileSize || maxSize <= 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    moveWindow(position);
+
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize && position < _fileSize) {
+        const int64_t blockOffset = position - position % BLOCK_SIZE;
+        Block &block = blockFor(blockOffset);
+
+        if (block.offset != blockOffset || block.state == BlockState::Empty || block.state == BlockState::Loading) {
+            // Only wait for the block if we have nothing to return yet
+            if (bytesRead > 0) {
+                break;
+            }
+            ++_stalls;
+            _blockLoaded.wait(lock, [&]{
+                return _stop || (block.offset == blockOffset &&
+                                 (block.state == BlockState::Ready || block.state == BlockState::Failed ||
+                                  block.state == BlockState::Unbuffered));
+            });
+            if (_stop) {
+                break;
+            }
+        }
+        if (block.state == BlockState::Failed) {
+            return bytesRead > 0 ? bytesRead : -1;
+        }
+
+        const int64_t blockPosition = position - blockOffset;
+        int64_t chunk = qMin(block.length - blockPosition, maxSize - bytesRead);
+        if (chunk <= 0) {
+            break;
+        }
+        if (block.state == BlockState::Unbuffered) {
+            lock.unlock();
+            chunk = readUnbuffered(position, data + bytesRead, chunk);
+            lock.lock();
+            if (chunk <= 0) {
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+        } else {
+            std::memcpy(data + bytesRead, block.data.data() + blockPosition, static_cast<size_t>(chunk));
+        }
+        bytesRead += chunk;
+        position += chunk;
+    }
+
+    _readEnd = qMax(_readEnd, position);
+    if (_stride != 0 && _readEnd - _seekTarget > qMax(_runLength, BLOCK_SIZE) + LINEAR_RESUME_BLOCKS * BLOCK_SIZE) {
+        resumeLinear();
+    }
+
+    // Reading may have moved us into the next block, which frees one for prefetching
+    moveWindow(position);
+    if (_targetMs > 0) {
+        adapt(bytesRead);
+    }
+    return bytesRead;
+}
+
+void MdkReadAhead::setAdaptive(int64_t targetMs, int64_t maxBufferSize)
+{
+    const size_t maxBlocks = static_cast<size_t>(qMax<int64_t>(MIN_BLOCK_COUNT, maxBufferSize / BLOCK_SIZE));
+    _targetMs = targetMs;
+    _windowBlocks = qMin<int64_t>(_windowBlocks, static_cast<int64_t>(maxBlocks));
+    _blocks.resize(maxBlocks);
+}
+
+void MdkReadAhead::setParallel(int threads, int64_t chunkSize)
+{
+    _threadCount = qBound(1, threads, MAX_THREADS);
+    _chunkSize = qBound(MIN_CHUNK_SIZE, chunkSize, BLOCK_SIZE);
+}
+
+MdkReadAhead::Status MdkReadAhead::status() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    Status status;
+    status.depth = _windowBlocks * BLOCK_SIZE;
+    status.readRate = _readRate;
+    status.loadLatency = _loadLatency;
+    status.stride = _stride;
+    status.stalls = _stalls;
+    return status;
+}
+
+void MdkReadAhead::seek(int64_t position)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Loads in flight go on, a failed or unbuffered block is retried
+        for (auto &block: _blocks) {
+            if (block.state == BlockState::Failed || block.state == BlockState::Unbuffered) {
+                block.state = BlockState::Empty;
+            }
+        }
+        detectStride(position);
+        _windowStart = qBound<int64_t>(0, position, _fileSize) / BLOCK_SIZE * BLOCK_SIZE;
+        updateWindow();
+    }
+    notifyWindowMoved();
+}
+
+void MdkReadAhead::moveWindow(int64_t position)
+{
+    const int64_t windowStart = qBound<int64_t>(0, position, _fileSize) / BLOCK_SIZE * BLOCK_SIZE;
+    if (windowStart != _windowStart) {
+        _windowStart = windowStart;
+        updateWindow();
+        notifyWindowMoved();
+    }
+}
+
+void MdkReadAhead::notifyWindowMoved()
+{
+    if (_threadCount > 1) {
+        // Each of them can take a chunk of the first new block
+        _windowMoved.notify_all();
+    } else {
+        _windowMoved.notify_one();
+    }
+}
+
+void MdkReadAhead::updateWindow()
+{
+    _window.clear();
+    if (_stride == 0) {
+        const int64_t windowEnd = qMin<int64_t>(_fileSize, _windowStart + _windowBlocks * BLOCK_SIZE);
+        for (int64_t offset = _windowStart; offset < windowEnd; offset += BLOCK_SIZE) {
+            _window.push_back(offset);
+        }
+        return;
+    }
+
+    // Enough blocks for the data read after each of the next seeks, however it is aligned
+    const int64_t run = qMax<int64_t>(1, _runLength);
+    const int64_t runBlocks = run / BLOCK_SIZE + 2;
+    const size_t limit = static_cast<size_t>(qMin<int64_t>(static_cast<int64_t>(_blocks.size()),
+                                                           qMax(_windowBlocks, runBlocks * (STRIDE_STEPS + 1))));
+    const auto add = [&](int64_t start, int64_t end) {
+        end = qMin(end, _fileSize);
+        for (int64_t offset = qMax<int64_t>(0, start) / BLOCK_SIZE * BLOCK_SIZE; offset < end && _window.size() < limit; offset += BLOCK_SIZE) {
+            if (std::find(_window.begin(), _window.end(), offset) == _window.end()) {
+                _window.push_back(offset);
+            }
+        }
+    };
+
+    // The rest of the current run first, then the runs at the next seek targets
+    add(_windowStart, qMax(_windowStart + 1, _seekTarget + run));
+    for (int step = 1; step <= STRIDE_STEPS; ++step) {
+        const int64_t target = _seekTarget + step * _stride;
+        if (target + run <= 0 || target >= _fileSize) {
+            break;
+        }
+        add(target, target + run);
+    }
+}
+
+void MdkReadAhead::detectStride(int64_t position)
+{
+    if (_seekTarget >= 0) {
+        if (position >= _seekTarget && position <= _readEnd + SKIP_TOLERANCE) {
+            // Reading on, maybe skipping a little
+            return;
+        }
+
+        const int64_t run = _readEnd - _seekTarget;
+        const int64_t distance = position - _seekTarget;
+        if (_candidateStride != 0 && (distance < 0) == (_candidateStride < 0) &&
+                qAbs(distance - _candidateStride) <= qAbs(_candidateStride) / 2) {
+            _candidateStride = (_candidateStride + distance) / 2;
+            _runLength = (_runLength + run) / 2;
+            ++_strideSeeks;
+        } else {
+            _candidateStride = distance;
+            _runLength = run;
+            _strideSeeks = 1;
+        }
+
+        const int64_t stride = (_strideSeeks >= STRIDE_CONFIRMATIONS) ? _candidateStride : 0;
+        if (stride != 0 && _stride == 0) {
+            MDKIO_TRACE(MDK_NS::Debug, "Read-ahead: prefetching along a stride of %lld bytes, %lld bytes per seek",
+                        static_cast<long long>(stride), static_cast<long long>(_runLength));
+        } else if (stride == 0 && _stride != 0) {
+            MDKIO_TRACE(MDK_NS::Debug, "Read-ahead: seek pattern broken, reading ahead sequentially");
+        }
+        _stride = stride;
+    }
+    _seekTarget = position;
+    _readEnd = position;
+}
+
+void MdkReadAhead::resumeLinear()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Read-ahead: playing on, reading ahead sequentially");
+    _stride = 0;
+    _candidateStride = 0;
+    _strideSeeks = 0;
+    updateWindow();
+    notifyWindowMoved();
+}
+
+void MdkReadAhead::adapt(int64_t bytesRead)
+{
+    _sampleBytes += qMax<int64_t>(0, bytesRead);
+    const auto now = std::chrono::steady_clock::now();
+    const int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - _sampleStart).count();
+    if (elapsedMs < ADAPT_INTERVAL_MS) {
+        return;
+    }
+
+    const int64_t rate = _sampleBytes * 1000 / elapsedMs;
+    _readRate = (_readRate == 0) ? rate : (_readRate * 3 + rate) / 4;
+    _sampleBytes = 0;
+    _sampleStart = now;
+
+    // Enough blocks for the target time, plus the time it takes to load one more
+    const int64_t wanted = _readRate * _targetMs / 1000 + _readRate * _loadLatency / 1000000000;
+    const int64_t blocks = qBound<int64_t>(MIN_BLOCK_COUNT, (wanted + BLOCK_SIZE - 1) / BLOCK_SIZE + 1,
+                                           static_cast<int64_t>(_blocks.size()));
+    if (blocks > _windowBlocks) {
+        _windowBlocks = blocks;
+        updateWindow();
+        notifyWindowMoved();
+    } else if (blocks < _windowBlocks) {
+        // Shrink gradually, a pause in reading shouldn't empty the buffer
+        --_windowBlocks;
+        updateWindow();
+    }
+}
+
+void MdkReadAhead::freeOutsideWindow()
+{
+    std::fill(_claimed.begin(), _claimed.end(), false);
+    const auto keep = [&](int64_t offset) {
+        if (offset >= 0 && _blocks[slotFor(offset)].offset == offset) {
+            _claimed[slotFor(offset)] = true;
+        }
+    };
+    // Keep the block before the window for short seeks back
+    keep(_windowStart - BLOCK_SIZE);
+    for (const int64_t offset: _window) {
+        keep(offset);
+    }
+
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        Block &block = _blocks[i];
+        if (!_claimed[i] && (!block.data.empty() || block.state == BlockState::Unbuffered) && block.writers == 0) {
+            block.state = BlockState::Empty;
+            block.offset = -1;
+            block.cached.reset();
+            block.data.clear();
+        }
+    }
+}
+
+void MdkReadAhead::startBlock(Block &block, int64_t offset)
+{
+    block.offset = offset;
+    block.state = BlockState::Loading;
+    block.length = qMin(BLOCK_SIZE, _fileSize - offset);
+    block.chunks = static_cast<int>((block.length + _chunkSize - 1) / _chunkSize);
+    block.chunksClaimed = 0;
+    block.chunksDone = 0;
+    if (block.data.size() != static_cast<size_t>(BLOCK_SIZE)) {
+        while (!block.data.allocate(BLOCK_SIZE) && _cache && _cache->evictOne()) {
+            // evicted a block, try again
+        }
+        if (block.data.empty()) {
+            // The arena is full, read() reads the block itself
+            block.state = BlockState::Unbuffered;
+            block.cached.reset();
+            _blockLoaded.notify_all();
+            return;
+        }
+    }
+
+    // A cached block is copied as a whole, by a single thread
+    block.cached = _cache ? _cache->find(offset) : nullptr;
+    if (block.cached) {
+        block.chunks = 1;
+    }
+}
+
+void MdkReadAhead::run(QFile &file)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+        // Find the first chunk in the window that still has to be loaded
+        Block *next = nullptr;
+        std::fill(_claimed.begin(), _claimed.end(), false);
+        for (const int64_t offset: _window) {
+            const size_t slot = slotFor(offset);
+            if (_claimed[slot]) {
+                // Along a stride, blocks further on can map to a slot taken by an earlier one
+                continue;
+            }
+            _claimed[slot] = true;
+            Block &block = _blocks[slot];
+            if (block.offset != offset || block.state == BlockState::Empty) {
+                if (block.writers > 0) {
+                    // Another thread is still loading what was there before a seek
+                    continue;
+                }
+                startBlock(block, offset);
+            }
+            if (block.state == BlockState::Loading && block.chunksClaimed < block.chunks) {
+                next = &block;
+                break;
+            }
+        }
+        if (next == nullptr) {
+            if (_blocks.size() > _window.size()) {
+                freeOutsideWindow();
+            }
+            _windowMoved.wait(lock);
+            continue;
+        }
+
+        // While this thread is a writer, the block keeps its offset and data
+        if (next->chunksClaimed == 0) {
+            next->loadStart = std::chrono::steady_clock::now();
+        }
+        const int64_t chunkOffset = next->chunksClaimed++ * _chunkSize;
+        const int64_t chunkLength = qMin(_chunkSize, next->length - chunkOffset);
+        const MdkBlockCache::Block cached = std::move(next->cached);
+        ++next->writers;
+        lock.unlock();
+
+        int64_t length = 0;
+        if (cached) {
+            length = static_cast<int64_t>(cached->size());
+            std::memcpy(next->data.data(), cached->data(), cached->size());
+        } else {
+            length = load(file, next->offset + chunkOffset, next->data.data() + chunkOffset, chunkLength);
+        }
+
+        lock.lock();
+        bool loaded = false;
+        if (next->state == BlockState::Loading) {
+            if (length < 0) {
+                next->state = BlockState::Failed;
+                _blockLoaded.notify_all();
+            } else {
+                if (cached) {
+                    next->length = length;
+                } else if (length < chunkLength) {
+                    // The file was truncated
+                    next->length = qMin(next->length, chunkOffset + length);
+                }
+                if (++next->chunksDone == next->chunks) {
+                    next->state = BlockState::Ready;
+                    loaded = !cached;
+                    if (loaded) {
+                        // From the first chunk to the last, however many threads loaded it
+                        const int64_t blockNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - next->loadStart).count();
+                        _loadLatency = (_loadLatency == 0) ? blockNs : (_loadLatency * 7 + blockNs) / 8;
+                    }
+                    _blockLoaded.notify_all();
+                }
+            }
+        }
+        if (loaded && _cache && next->length > 0) {
+            // Still a writer, so the data can't change while it is copied
+            const int64_t offset = next->offset;
+            const uint8_t *data = next->data.data();
+            const int64_t blockLength = next->length;
+            lock.unlock();
+            auto copy = std::make_shared<MdkBlockArena::Data>();
+            if (copy->allocate(static_cast<size_t>(blockLength))) {
+                std::memcpy(copy->data(), data, static_cast<size_t>(blockLength));
+                _cache->insert(offset, std::move(copy));
+            }
+            lock.lock();
+        }
+        if (--next->writers == 0 && _threadCount > 1) {
+            // Others may be waiting to reuse the block
+            _windowMoved.notify_all();
+        }
+    }
+}
+
+int64_t MdkReadAhead::load(QFile &file, int64_t offset, uint8_t *data, int64_t length)
+{
+    if (_diskCache && _diskCache->read(offset, data, length)) {
+        return length;
+    }
+
+    int64_t bytesRead = -1;
+    if (file.seek(offset)) {
+        bytesRead = file.read(reinterpret_cast<char*>(data), length);
+    }
+    if (_diskCache && bytesRead > 0) {
+        _diskCache->write(offset, data, bytesRead);
+    }
+    return bytesRead;
+}
+
+int64_t MdkReadAhead::readUnbuffered(int64_t position, uint8_t *data, int64_t length)
+{
+    if (!_readFile) {
+        _readFile = std::make_unique<QFile>(_fileName);
+        if (!_readFile->open(QFile::ReadOnly | QFile::Unbuffered)) {
+            _readFile.reset();
+            return -1;
+        }
+    }
+    return load(*_readFile, position, data, length);
+}
@@ -0,0 +1,225 @@
+#ifndef MDKREADAHEAD_H
+#define MDKREADAHEAD_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include "mdkblockcache.h"
+#include "mdkdiskcache.h"
+
+/**
+ * Background prefetcher that keeps a ring of fixed-size blocks filled ahead
+ * of the read position.
+ *
+ * The prefetch thread reads through its own QFile, so the demux thread only
+ * copies from blocks that are already resident and only blocks when the
+ * block it needs has not been loaded yet. Seeking restarts the window at
+ * the new position, keeping blocks that are still inside the new window.
+ *
+ * With setParallel() several prefetch threads, each with its own QFile,
+ * load the window in chunks of a block, the first blocks of the window
+ * first. This keeps several requests in flight, which fast drives and
+ * RAID sets need to reach their full throughput.
+ *
+ * When the MdkBlockArena is full, blocks that can't get memory, after
+ * evicting from the block cache, are left to read(), which reads them from
+ * the file itself straight into the caller's buffer. Reading goes on at the
+ * speed of the disk until memory is available again.
+ *
+ * If a block cache is set, blocks are taken from it when possible and every
+ * block loaded from disk is added to it. A disk cache copy set with
+ * setDiskCache() is used the same way, below the block cache.
+ *
+ * With setAdaptive() the depth of the window follows the rate at which the
+ * data is read and the time it takes to load a block, to keep a target
+ * number of milliseconds buffered without exceeding a memory ceiling.
+ * Blocks outside the window are freed, so memory use follows the depth.
+ *
+ * Seeks are watched for a pattern, as produced by reverse playback (a GOP
+ * back at a time) or fast forward (skipping to every Nth key frame). Once
+ * STRIDE_CONFIRMATIONS seeks in a row move by about the same distance, the
+ * window holds the data read after a seek at the next seek targets along
+ * that stride, backwards or forwards, instead of the data following the
+ * read position. Reading on well past the usual amount, or a seek breaking
+ * the pattern, returns to plain sequential read-ahead.
+ */
+class MdkReadAhead
+{
+public:
+    /** Size of a single prefetch block */
+    static constexpr int64_t BLOCK_SIZE = 1024 * 1024;
+    /** Minimum number of blocks in the ring, regardless of the buffer size */
+    static constexpr int MIN_BLOCK_COUNT = 2;
+    /** Interval at which the read rate is sampled and an adaptive window resized */
+    static constexpr int64_t ADAPT_INTERVAL_MS = 250;
+    /** Number of successive seeks by a similar distance before prefetching along that stride */
+    static constexpr int STRIDE_CONFIRMATIONS = 2;
+    /** Number of seek targets ahead prefetched along a stride */
+    static constexpr int STRIDE_STEPS = 4;
+    /** Forward seeks up to this distance past the data read are taken as skipping, not seeking */
+    static constexpr int64_t SKIP_TOLERANCE = 64 * 1024;
+    /** Blocks read past the usual amount after a seek before returning to sequential read-ahead */
+    static constexpr int64_t LINEAR_RESUME_BLOCKS = 4;
+    /** Limits of setParallel() */
+    static constexpr int MAX_THREADS = 16;
+    static constexpr int64_t MIN_CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * Create a prefetcher for fileName, buffering bufferSize bytes ahead of
+     * the read position. Call start() to open the file and start prefetching.
+     */
+    MdkReadAhead(const QString &fileName, int64_t bufferSize);
+    ~MdkReadAhead();
+
+    MdkReadAhead(const MdkReadAhead &) = delete;
+    MdkReadAhead &operator=(const MdkReadAhead &) = delete;
+
+    /** Share cache with the prefetch thread. Must be called before start(). */
+    void setCache(std::shared_ptr<MdkBlockCache> cache) { _cache = std::move(cache); }
+
+    /** Read through this local copy of the file. Must be called before start(). */
+    void setDiskCache(std::shared_ptr<MdkDiskCache::File> diskCache) { _diskCache = std::move(diskCache); }
+
+    /**
+     * Size the window to hold targetMs of data at the measured read rate,
+     * up to maxBufferSize bytes, starting at the buffer size given to the
+     * constructor. Must be called before start().
+     */
+    void setAdaptive(int64_t targetMs, int64_t maxBufferSize);
+
+    /**
+     * Load blocks with threads prefetch threads, in pieces of chunkSize
+     * bytes, at most BLOCK_SIZE. The default is a single thread loading
+     * whole blocks. Must be called before start().
+     */
+    void setParallel(int threads, int64_t chunkSize);
+
+    /** Open the file and start the prefetch threads. Returns false if the file cannot be opened. */
+    bool start();
+
+    /** Size of the file */
+    int64_t size() const { return _fileSize; }
+
+    /**
+     * Read at most maxSize bytes at position. Blocks only if the block at
+     * position has not been prefetched yet.
+     * \return bytes read, 0 at the end of the file, -1 on a read error.
+     */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize);
+
+    /** Cancel prefetches in flight and restart the window at position */
+    void seek(int64_t position);
+
+    struct Status {
+        /** Current size of the window in bytes */
+        int64_t depth = 0;
+        /** Smoothed rate at which data is read, in bytes per second */
+        int64_t readRate = 0;
+        /** Smoothed time to load a block, from its first chunk to its last, in nanoseconds */
+        int64_t loadLatency = 0;
+        /** Distance between the seek targets being prefetched, negative backwards, 0 when reading sequentially */
+        int64_t stride = 0;
+        /** Number of reads that had to wait for a block to be loaded */
+        int64_t stalls = 0;
+    };
+
+    Status status() const;
+
+private:
+    enum class BlockState {
+        Empty,
+        Loading,
+        Ready,
+        Failed,
+        /** There was no memory for the block, read() reads it from the file */
+        Unbuffered
+    };
+
+    struct Block {
+        BlockState state = BlockState::Empty;
+        int64_t offset = -1;
+        int64_t length = 0;
+        /** Chunks in the block, handed out to threads and loaded */
+        int chunks = 0;
+        int chunksClaimed = 0;
+        int chunksDone = 0;
+        /** Threads writing to data; until they are done the block can't be reused */
+        int writers = 0;
+        /** When the first chunk was claimed, to time loading the whole block */
+        std::chrono::steady_clock::time_point loadStart;
+        MdkBlockCache::Block cached;
+        MdkBlockArena::Data data;
+    };
+
+    size_t slotFor(int64_t offset) const { return static_cast<size_t>((offset / BLOCK_SIZE) % _blocks.size()); }
+    Block &blockFor(int64_t offset) { return _blocks[slotFor(offset)]; }
+    void moveWindow(int64_t position);
+    void updateWindow();
+    /** Wake the prefetch threads after the window changed, all of them when loading in parallel */
+    void notifyWindowMoved();
+    void detectStride(int64_t position);
+    void resumeLinear();
+    void adapt(int64_t bytesRead);
+    void freeOutsideWindow();
+    void startBlock(Block &block, int64_t offset);
+    void run(QFile &file);
+    int64_t load(QFile &file, int64_t offset, uint8_t *data, int64_t length);
+    /** Read an Unbuffered block on the reading thread */
+    int64_t readUnbuffered(int64_t position, uint8_t *data, int64_t length);
+
+    QString _fileName;
+    /** One per prefetch thread */
+    std::vector<std::unique_ptr<QFile>> _files;
+    /** Opened by the reading thread for Unbuffered blocks */
+    std::unique_ptr<QFile> _readFile;
+    std::shared_ptr<MdkBlockCache> _cache;
+    std::shared_ptr<MdkDiskCache::File> _diskCache;
+    int64_t _fileSize = 0;
+    int _threadCount = 1;
+    int64_t _chunkSize = BLOCK_SIZE;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _blockLoaded;
+    std::condition_variable _windowMoved;
+    std::vector<Block> _blocks;
+    /** Offset of the first block of the prefetch window */
+    int64_t _windowStart = 0;
+    /** Number of blocks in the window, at most the number of blocks in the ring */
+    int64_t _windowBlocks = 0;
+    /** Offsets of the blocks in the window, in the order they are loaded */
+    std::vector<int64_t> _window;
+    /** Scratch space for marking ring slots taken by the window */
+    std::vector<bool> _claimed;
+
+    /** Target of the last seek and the furthest position read since */
+    int64_t _seekTarget = -1;
+    int64_t _readEnd = 0;
+    /** Smoothed number of bytes read after a seek */
+    int64_t _runLength = 0;
+    /** Distance of the last seeks and the number of seeks in a row moving about that far */
+    int64_t _candidateStride = 0;
+    int _strideSeeks = 0;
+    /** Stride being prefetched along, 0 for sequential read-ahead */
+    int64_t _stride = 0;
+    int64_t _stalls = 0;
+
+    /** Target buffered time in ms, 0 for a fixed window */
+    int64_t _targetMs = 0;
+    int64_t _readRate = 0;
+    int64_t _loadLatency = 0;
+    /** Bytes read since the start of the current rate sample */
+    int64_t _sampleBytes = 0;
+    std::chrono::steady_clock::time_point _sampleStart;
+    bool _stop = false;
+
+    std::vector<std::thread> _threads;
+};
+
+#endif // MDKREADAHEAD_H
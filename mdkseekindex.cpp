@@ -0,0 +1,218 @@
+#include "mdkseekindex.h"
+#include "mdkendian.h"
+#include "mdktrace.h"
+#include <algorithm>
+#include <cstring>
+#include <QtCore/QByteArray>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDateTime>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QStandardPaths>
+
+namespace {
+
+/**
+ * Sidecar layout: magic, file size, modification time in ms, last session
+ * and entry count, then offset, size, hits and session of each entry, in
+ * the order of extents(), all 8 bytes
+ */
+const char MAGIC[8] = {'M', 'D', 'K', 'S', 'I', 'D', 'X', '2'};
+constexpr int HEADER_SIZE = 40;
+constexpr int ENTRY_SIZE = 32;
+
+}
+
+MdkSeekIndex::MdkSeekIndex(const QString &directory, const QString &fileName):
+    _directory(directory)
+{
+    const QFileInfo info(fileName);
+    const QString canonicalPath = info.canonicalFilePath();
+    if (canonicalPath.isEmpty()) {
+        return;
+    }
+    _fileSize = info.size();
+    _modified = info.lastModified().toMSecsSinceEpoch();
+    const QByteArray hash = QCryptographicHash::hash(canonicalPath.toUtf8(), QCryptographicHash::Sha1).toHex();
+    _path = QDir(directory).filePath(QString::fromLatin1(hash) + ".idx");
+    if (!load()) {
+        _entries.clear();
+        _session = 1;
+    }
+    for (const Entry &entry: _entries) {
+        _extents.push_back({entry.offset, entry.size});
+    }
+}
+
+MdkSeekIndex::~MdkSeekIndex()
+{
+    save();
+}
+
+QString MdkSeekIndex::defaultDirectory()
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("mdkio-index");
+}
+
+void MdkSeekIndex::recordSeek(int64_t position)
+{
+    if (position != _runEnd) {
+        endRun();
+        _runStart = position;
+        _runEnd = position;
+    }
+}
+
+void MdkSeekIndex::recordRead(int64_t position, int64_t length)
+{
+    if (length <= 0) {
+        return;
+    }
+    if (_opening && isSample(position)) {
+        // What came before is the opening, the samples read from here on a seek run
+        endRun();
+        _opening = false;
+        _runStart = position;
+        _runEnd = position;
+    } else if (position != _runEnd) {
+        recordSeek(position);
+    }
+    _runEnd += length;
+}
+
+void MdkSeekIndex::endRun()
+{
+    if (_runEnd <= _runStart || _recorded.size() >= MAX_EXTENTS) {
+        return;
+    }
+    if (_opening) {
+        _recorded.push_back({_runStart, qMin(MAX_RUN_SIZE, _runEnd - _runStart), 0, _session});
+        if (_mediaData.size <= 0 && ++_runs >= OPEN_RUNS) {
+            _opening = false;
+        }
+    } else {
+        _recorded.push_back({_runStart, qMin(SEEK_RUN_SIZE, _runEnd - _runStart), 1, _session});
+    }
+}
+
+bool MdkSeekIndex::isSample(int64_t position) const
+{
+    return position >= _mediaData.offset && position < _mediaData.offset + _mediaData.size;
+}
+
+bool MdkSeekIndex::load()
+{
+    QFile file(_path);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data.constData());
+    if (data.size() < HEADER_SIZE || std::memcmp(bytes, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    if (static_cast<int64_t>(littleEndian64(bytes + 8)) != _fileSize ||
+            static_cast<int64_t>(littleEndian64(bytes + 16)) != _modified) {
+        MDKIO_TRACE(MDK_NS::Debug, "Seek index %s is stale", qPrintable(_path));
+        return false;
+    }
+    const uint64_t lastSession = littleEndian64(bytes + 24);
+    const uint64_t count = littleEndian64(bytes + 32);
+    if (count > MAX_EXTENTS || static_cast<uint64_t>(data.size()) != HEADER_SIZE + count * ENTRY_SIZE) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; ++i) {
+        const uint8_t *entry = bytes + HEADER_SIZE + i * ENTRY_SIZE;
+        const int64_t offset = static_cast<int64_t>(littleEndian64(entry));
+        const int64_t size = static_cast<int64_t>(littleEndian64(entry + 8));
+        const uint64_t hits = littleEndian64(entry + 16);
+        const uint64_t session = littleEndian64(entry + 24);
+        if (offset < 0 || size <= 0 || size > _fileSize - offset || session > lastSession) {
+            return false;
+        }
+        _entries.push_back({offset, size, hits, session});
+    }
+    _session = lastSession + 1;
+    return true;
+}
+
+std::vector<MdkSeekIndex::Entry> MdkSeekIndex::merged(std::vector<Entry> entries) const
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.offset < b.offset;
+    });
+    std::vector<Entry> result;
+    for (const Entry &entry: entries) {
+        if (result.empty() || entry.offset > result.back().offset + result.back().size) {
+            result.push_back(entry);
+            continue;
+        }
+        Entry &last = result.back();
+        // A range of an earlier session read again in this one counts once more
+        const bool again = entry.hits > 0 && ((last.session == _session) != (entry.session == _session));
+        last.hits = qMax(last.hits, entry.hits) + (again ? 1 : 0);
+        last.session = qMax(last.session, entry.session);
+        last.size = qMax(last.size, entry.offset + entry.size - last.offset);
+    }
+    return result;
+}
+
+bool MdkSeekIndex::save()
+{
+    endRun();
+    _runStart = _runEnd;
+    if (_path.isEmpty() || _recorded.empty()) {
+        return true;
+    }
+
+    // The opening recorded last replaces the earlier one, seek runs are merged and aged
+    const bool opened = std::any_of(_recorded.begin(), _recorded.end(), [](const Entry &entry) { return entry.hits == 0; });
+    std::vector<Entry> open;
+    std::vector<Entry> seeks;
+    for (const std::vector<Entry> *entries: {&_entries, &_recorded}) {
+        for (const Entry &entry: *entries) {
+            if (entry.hits > 0) {
+                if (entry.session + MAX_AGE >= _session) {
+                    seeks.push_back(entry);
+                }
+            } else if (entries == &_recorded || !opened || entry.session == _session) {
+                open.push_back(entry);
+            }
+        }
+    }
+    std::vector<Entry> entries = merged(std::move(open));
+    seeks = merged(std::move(seeks));
+    std::sort(seeks.begin(), seeks.end(), [](const Entry &a, const Entry &b) {
+        return a.hits != b.hits ? a.hits > b.hits : a.session > b.session;
+    });
+    entries.insert(entries.end(), seeks.begin(), seeks.end());
+    if (entries.size() > MAX_EXTENTS) {
+        entries.resize(MAX_EXTENTS);
+    }
+
+    QByteArray data(MAGIC, sizeof(MAGIC));
+    appendLittleEndian64(data, static_cast<uint64_t>(_fileSize));
+    appendLittleEndian64(data, static_cast<uint64_t>(_modified));
+    appendLittleEndian64(data, _session);
+    appendLittleEndian64(data, entries.size());
+    for (const Entry &entry: entries) {
+        appendLittleEndian64(data, static_cast<uint64_t>(entry.offset));
+        appendLittleEndian64(data, static_cast<uint64_t>(entry.size));
+        appendLittleEndian64(data, entry.hits);
+        appendLittleEndian64(data, entry.session);
+    }
+
+    // Written to a temporary file and renamed, so concurrent readers see either version whole
+    QSaveFile file(_path);
+    if (!QDir().mkpath(_directory) || !file.open(QFile::WriteOnly) ||
+            file.write(data) != data.size() || !file.commit()) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to write seek index %s", qPrintable(_path));
+        return false;
+    }
+    _entries = std::move(entries);
+    _recorded.clear();
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef MDKSEEKINDEX_H
+#define MDKSEEKINDEX_H
+
+#include <cstdint>
+#include <vector>
+#include <QtCore/QString>
+
+#include "mdkmp4prefetch.h"
+
+/**
+ * Remembers the parts of a file the demuxer reads when opening it and
+ * after seeking, in a sidecar file in a cache directory, so they can be
+ * read in one pass with MdkMp4Prefetch::loadExtents() the next time the
+ * file is opened.
+ *
+ * Reads are grouped into runs, which start when the file is opened or
+ * sought and go on while the reads are contiguous. The runs before the
+ * first read of a sample, in the media data set with setMediaData(), are
+ * opening the file (headers and the sample index) and are recorded up to
+ * MAX_RUN_SIZE bytes; without media data the first OPEN_RUNS runs are.
+ * Later runs start at key frames, of which only the first SEEK_RUN_SIZE
+ * bytes are recorded.
+ *
+ * Each time the file is opened is a session. The opening recorded last
+ * replaces the one in the sidecar, while seek runs are merged with those
+ * in it, counting the sessions a range was read in, so the sidecar collects
+ * the seek targets used over time. Seek runs not read again for MAX_AGE
+ * sessions are dropped.
+ *
+ * The sidecar is named after a hash of the canonical path of the file and
+ * holds its size and modification time; a sidecar for a file that has
+ * changed since is ignored and replaced.
+ */
+class MdkSeekIndex
+{
+public:
+    /** Number of runs taken as opening the file */
+    static constexpr int OPEN_RUNS = 4;
+    /** Longest part of a run recorded while opening the file */
+    static constexpr int64_t MAX_RUN_SIZE = 16 * 1024 * 1024;
+    /** Longest part of a run recorded after a later seek */
+    static constexpr int64_t SEEK_RUN_SIZE = 256 * 1024;
+    /** Most ranges kept in a sidecar */
+    static constexpr size_t MAX_EXTENTS = 4096;
+    /** Sessions after which a seek run that wasn't read again is dropped */
+    static constexpr uint64_t MAX_AGE = 32;
+
+    /** Index of fileName kept in directory, reading the sidecar there if it matches the file */
+    MdkSeekIndex(const QString &directory, const QString &fileName);
+    /** Saves what was recorded */
+    ~MdkSeekIndex();
+
+    MdkSeekIndex(const MdkSeekIndex &) = delete;
+    MdkSeekIndex &operator=(const MdkSeekIndex &) = delete;
+
+    /** "mdkio-index" in the cache location of the application */
+    static QString defaultDirectory();
+
+    /**
+     * Ranges read from the sidecar, most wanted first: the opening, then
+     * the seek runs read in most sessions, the most recent first. Empty if
+     * there was no valid sidecar.
+     */
+    const std::vector<MdkMp4Prefetch::Extent> &extents() const { return _extents; }
+
+    /** Where the samples are, see MdkMp4Prefetch::mediaData(). The opening ends with the first read in there. */
+    void setMediaData(const MdkMp4Prefetch::Extent &mediaData) { _mediaData = mediaData; }
+
+    void recordSeek(int64_t position);
+    void recordRead(int64_t position, int64_t length);
+
+    /** Merge what was recorded into the sidecar. Returns false if it can't be written. */
+    bool save();
+
+private:
+    struct Entry {
+        int64_t offset;
+        int64_t size;
+        /** Number of sessions the range was read in after a seek, 0 for the opening */
+        uint64_t hits;
+        /** Session the range was last read in */
+        uint64_t session;
+    };
+
+    void endRun();
+    bool isSample(int64_t position) const;
+    bool load();
+    /** Sort entries by offset and merge those overlapping or touching */
+    std::vector<Entry> merged(std::vector<Entry> entries) const;
+
+    QString _directory;
+    QString _path;
+    int64_t _fileSize = 0;
+    int64_t _modified = 0;
+
+    /** Entries of the sidecar, in the order of extents() */
+    std::vector<Entry> _entries;
+    std::vector<MdkMp4Prefetch::Extent> _extents;
+    /** Runs recorded in this session, which is one more than the last one in the sidecar */
+    std::vector<Entry> _recorded;
+    uint64_t _session = 1;
+    MdkMp4Prefetch::Extent _mediaData = {0, 0};
+    bool _opening = true;
+    int _runs = 0;
+    int64_t _runStart = 0;
+    int64_t _runEnd = 0;
+};
+
+#endif // MDKSEEKINDEX_H
@@ -0,0 +1,131 @@
+#include "mdksharedfile.h"
+#include <cerrno>
+#include <map>
+#include <tuple>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+
+#if defined Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+/** Canonical path, device, inode, size and modification time in ns of a file */
+using Key = std::tuple<QString, int64_t, int64_t, int64_t, int64_t>;
+
+std::mutex registryMutex;
+std::map<Key, std::weak_ptr<MdkSharedFile>> registry;
+
+#if defined Q_OS_UNIX
+int64_t modifiedNs(const struct stat &status)
+{
+#if defined Q_OS_MAC
+    return static_cast<int64_t>(status.st_mtimespec.tv_sec) * 1000000000 + status.st_mtimespec.tv_nsec;
+#else
+    return static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+#endif
+}
+#endif
+
+}
+
+MdkSharedFile::MdkSharedFile(const QString &fileName, int fd, int64_t size):
+    _fileName(fileName),
+    _fd(fd),
+    _size(size)
+{
+    // empty
+}
+
+MdkSharedFile::~MdkSharedFile()
+{
+#if defined Q_OS_UNIX
+    ::close(_fd);
+#endif
+}
+
+std::shared_ptr<MdkSharedFile> MdkSharedFile::open(const QString &fileName)
+{
+#if defined Q_OS_UNIX
+    const QString path = QFileInfo(fileName).canonicalFilePath();
+    if (path.isEmpty()) {
+        return nullptr;
+    }
+
+    // The descriptor is opened first, so the key describes the file it reads
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    const Key key(path, static_cast<int64_t>(status.st_dev), static_cast<int64_t>(status.st_ino),
+                  static_cast<int64_t>(status.st_size), modifiedNs(status));
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto found = registry.find(key);
+    if (found != registry.end()) {
+        if (std::shared_ptr<MdkSharedFile> file = found->second.lock()) {
+            ::close(fd);
+            return file;
+        }
+    }
+
+    std::shared_ptr<MdkSharedFile> file(new MdkSharedFile(path, fd, static_cast<int64_t>(status.st_size)));
+    registry[key] = file;
+
+    // Drop entries of files that have been closed since
+    for (auto entry = registry.begin(); entry != registry.end();) {
+        entry = entry->second.expired() ? registry.erase(entry) : std::next(entry);
+    }
+    return file;
+#else
+    Q_UNUSED(fileName)
+    return nullptr;
+#endif
+}
+
+int64_t MdkSharedFile::read(int64_t position, uint8_t *data, int64_t maxSize) const
+{
+#if defined Q_OS_UNIX
+    if (position < 0 || position >= _size || maxSize <= 0) {
+        return 0;
+    }
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize) {
+        const ssize_t result = ::pread(_fd, data + bytesRead, static_cast<size_t>(maxSize - bytesRead),
+                                       static_cast<off_t>(position + bytesRead));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return bytesRead > 0 ? bytesRead : -1;
+        }
+        if (result == 0) {
+            break;
+        }
+        bytesRead += result;
+    }
+    return bytesRead;
+#else
+    Q_UNUSED(position)
+    Q_UNUSED(data)
+    Q_UNUSED(maxSize)
+    return -1;
+#endif
+}
+
+std::shared_ptr<MdkBlockCache> MdkSharedFile::cache(int64_t budget, int64_t blockSize)
+{
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    if (!_cache) {
+        _cache = std::make_shared<MdkBlockCache>(budget, blockSize);
+    }
+    return _cache;
+}
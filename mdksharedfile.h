@@ -0,0 +1,61 @@
+#ifndef MDKSHAREDFILE_H
+#define MDKSHAREDFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <QtCore/QString>
+
+#include "mdkblockcache.h"
+
+/**
+ * A read-only file descriptor shared by all readers of the same file.
+ *
+ * open() returns the instance for a canonical path if one is still in use
+ * and the file there is still the same, by inode, size and modification
+ * time, so players showing the same video, or separate audio and video
+ * readers, share one descriptor and one block cache. A file replaced under
+ * the same path gets an instance of its own. Reads are positional (pread),
+ * so every reader keeps its own position without locking or disturbing the
+ * others. The file is closed when the last reader releases it.
+ *
+ * Only available on Unix, open() returns nullptr elsewhere.
+ */
+class MdkSharedFile
+{
+public:
+    ~MdkSharedFile();
+
+    MdkSharedFile(const MdkSharedFile &) = delete;
+    MdkSharedFile &operator=(const MdkSharedFile &) = delete;
+
+    /** Get the shared file for fileName, opening it if needed. nullptr on failure. */
+    static std::shared_ptr<MdkSharedFile> open(const QString &fileName);
+
+    const QString &fileName() const { return _fileName; }
+
+    /** Size of the file when it was opened */
+    int64_t size() const { return _size; }
+
+    /** Read up to maxSize bytes at position. Returns the number of bytes read, -1 on error. */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize) const;
+
+    /**
+     * The block cache shared by the readers of this file. Created by the
+     * first caller with the given budget; later callers get the same cache
+     * whatever budget they ask for.
+     */
+    std::shared_ptr<MdkBlockCache> cache(int64_t budget, int64_t blockSize);
+
+private:
+    MdkSharedFile(const QString &fileName, int fd, int64_t size);
+
+    const QString _fileName;
+    const int _fd;
+    const int64_t _size;
+
+    std::mutex _cacheMutex;
+    std::shared_ptr<MdkBlockCache> _cache;
+};
+
+#endif // MDKSHAREDFILE_H
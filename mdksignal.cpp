@@ -0,0 +1,67 @@
+#include "mdksignal.h"
+#include <chrono>
+#include <thread>
+#include <QtCore/QtGlobal>
+
+#if defined _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined Q_OS_LINUX
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+void cpuRelax()
+{
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+    _mm_pause();
+#elif defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+    __builtin_ia32_pause();
+#elif defined __GNUC__ && defined __aarch64__
+    asm volatile("yield");
+#endif
+}
+
+}
+
+void MdkSignal::notify()
+{
+    _value.fetch_add(1, std::memory_order_seq_cst);
+    if (_sleepers.load(std::memory_order_seq_cst) == 0) {
+        return;
+    }
+#if defined Q_OS_LINUX
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_value), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+void MdkSignal::wait(uint32_t seen, int timeoutMs)
+{
+    for (int i = 0; i < SPIN_COUNT; ++i) {
+        if (_value.load(std::memory_order_acquire) != seen) {
+            return;
+        }
+        cpuRelax();
+    }
+
+    _sleepers.fetch_add(1, std::memory_order_seq_cst);
+#if defined Q_OS_LINUX
+    // Returns at once if the value has changed since seen
+    timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_value), FUTEX_WAIT_PRIVATE, seen, &timeout, nullptr, 0);
+#else
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while (_value.load(std::memory_order_acquire) == seen && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+#endif
+    _sleepers.fetch_sub(1, std::memory_order_seq_cst);
+}
@@ -0,0 +1,36 @@
+#ifndef MDKSIGNAL_H
+#define MDKSIGNAL_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Wakes a thread waiting for something lock-free to change, such as an
+ * MdkSpscRing becoming non-empty.
+ *
+ * The waiter takes value() before checking its condition, and passes it to
+ * wait() if the condition doesn't hold; a notify() in between makes wait()
+ * return at once. wait() spins for a short while first, as the other side
+ * is usually only a memcpy away, and then sleeps on a futex on Linux. On
+ * other platforms it sleeps in short steps instead.
+ */
+class MdkSignal
+{
+public:
+    /** Number of times value() is polled before going to sleep */
+    static constexpr int SPIN_COUNT = 2000;
+
+    uint32_t value() const { return _value.load(std::memory_order_seq_cst); }
+
+    /** Wake up waiters. Cheap when nobody is sleeping. */
+    void notify();
+
+    /** Wait until value() differs from seen, or at most timeoutMs */
+    void wait(uint32_t seen, int timeoutMs);
+
+private:
+    std::atomic<uint32_t> _value{0};
+    std::atomic<uint32_t> _sleepers{0};
+};
+
+#endif // MDKSIGNAL_H
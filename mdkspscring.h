@@ -0,0 +1,78 @@
+#ifndef MDKSPSCRING_H
+#define MDKSPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Lock-free ring buffer for exactly one producer thread and one consumer
+ * thread.
+ *
+ * The producer and consumer indices are on separate cache lines, so the
+ * two threads only share a line when one of them has to look at the other's
+ * index to see whether the ring is full or empty.
+ */
+template<typename T>
+class MdkSpscRing
+{
+public:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    /** capacity is rounded up to a power of two */
+    explicit MdkSpscRing(size_t capacity):
+        _slots(roundUp(capacity)),
+        _mask(_slots.size() - 1)
+    {
+        // empty
+    }
+
+    MdkSpscRing(const MdkSpscRing &) = delete;
+    MdkSpscRing &operator=(const MdkSpscRing &) = delete;
+
+    size_t capacity() const { return _slots.size(); }
+
+    /** Producer only. Returns false, leaving value alone, if the ring is full. */
+    bool tryPush(T &value)
+    {
+        const uint64_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == _slots.size()) {
+            return false;
+        }
+        _slots[head & _mask] = std::move(value);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Consumer only. Returns false if the ring is empty. */
+    bool tryPop(T &value)
+    {
+        const uint64_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(_slots[tail & _mask]);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static size_t roundUp(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    std::vector<T> _slots;
+    const size_t _mask;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> _head{0};
+    /** Aligning the members pads the class, so nothing else shares the tail's line */
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> _tail{0};
+};
+
+#endif // MDKSPSCRING_H
@@ -0,0 +1,35 @@
+#include "mdkstagingbuffer.h"
+#include <algorithm>
+#include <cstring>
+
+MdkStagingBuffer::MdkStagingBuffer(int64_t capacity):
+    _data(static_cast<size_t>((capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT))
+{
+    // empty
+}
+
+int64_t MdkStagingBuffer::read(int64_t position, uint8_t *data, int64_t maxSize) const
+{
+    if (position < _offset || position >= _offset + _length || maxSize <= 0) {
+        return 0;
+    }
+    const int64_t bufferPosition = position - _offset;
+    const int64_t chunk = std::min(_length - bufferPosition, maxSize);
+    std::memcpy(data, _data.data() + bufferPosition, static_cast<size_t>(chunk));
+    return chunk;
+}
+
+uint8_t *MdkStagingBuffer::prepare(int64_t position, int64_t &length)
+{
+    // At least capacity() - ALIGNMENT bytes, as capacity() is aligned
+    const int64_t end = (position + capacity()) / ALIGNMENT * ALIGNMENT;
+    _offset = position;
+    _length = 0;
+    length = end - position;
+    return _data.data();
+}
+
+void MdkStagingBuffer::loaded(int64_t length)
+{
+    _length = (length > 0) ? length : 0;
+}
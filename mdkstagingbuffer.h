@@ -0,0 +1,56 @@
+#ifndef MDKSTAGINGBUFFER_H
+#define MDKSTAGINGBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Buffer serving the small reads of a demuxer from one large read.
+ *
+ * A demuxer reads box and packet headers a few bytes at a time, and the
+ * payload following them in somewhat larger pieces. A small read that
+ * misses the buffer fills it from the read position with a single read of
+ * about capacity() bytes, ending at an ALIGNMENT boundary so the next fill
+ * starts aligned, and the reads that follow are copied from it. Reads that
+ * are not small and miss the buffer should go to the file directly.
+ */
+class MdkStagingBuffer
+{
+public:
+    /** Fills end at a multiple of this */
+    static constexpr int64_t ALIGNMENT = 4096;
+    /** Reads below capacity() / SMALL_READ_DIVISOR are small */
+    static constexpr int64_t SMALL_READ_DIVISOR = 8;
+
+    /** capacity is rounded up to a multiple of ALIGNMENT */
+    explicit MdkStagingBuffer(int64_t capacity);
+
+    int64_t capacity() const { return static_cast<int64_t>(_data.size()); }
+
+    /** Whether a read of size bytes should fill the buffer when it misses */
+    bool isSmall(int64_t size) const { return size < capacity() / SMALL_READ_DIVISOR; }
+
+    /** Whether position lies in the buffered data or directly after it */
+    bool covers(int64_t position) const { return _length > 0 && position >= _offset && position <= _offset + _length; }
+
+    /** Copy at most maxSize buffered bytes at position. Returns 0 if position is not buffered. */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize) const;
+
+    /**
+     * Start filling the buffer at position, dropping what it holds. Returns
+     * where to read length bytes to, after which loaded() has to be called.
+     */
+    uint8_t *prepare(int64_t position, int64_t &length);
+
+    /** Set the number of bytes read into the buffer by the last prepare(), which may be less than asked for or -1 on errors */
+    void loaded(int64_t length);
+
+    void clear() { _length = 0; }
+
+private:
+    std::vector<uint8_t> _data;
+    int64_t _offset = 0;
+    int64_t _length = 0;
+};
+
+#endif // MDKSTAGINGBUFFER_H
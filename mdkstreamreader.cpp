@@ -0,0 +1,209 @@
+#include "mdkstreamreader.h"
+#include <cstring>
+
+MdkStreamReader::MdkStreamReader(const QString &fileName, int64_t bufferSize):
+    _file(fileName),
+    _blocks(static_cast<size_t>(qMax<int64_t>(MIN_BLOCK_COUNT, bufferSize / BLOCK_SIZE))),
+    _spare(static_cast<size_t>(qMax<int64_t>(MIN_BLOCK_COUNT, bufferSize / BLOCK_SIZE)))
+{
+    // empty
+}
+
+MdkStreamReader::~MdkStreamReader()
+{
+    _stop = true;
+    _blockTaken.notify();
+    _blockPushed.notify();
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+bool MdkStreamReader::start()
+{
+    if (!_file.open(QFile::ReadOnly | QFile::Unbuffered)) {
+        return false;
+    }
+    _fileSize = _file.size();
+    _thread = std::thread([this]{ run(); });
+    return true;
+}
+
+int64_t MdkStreamReader::read(int64_t position, uint8_t *data, int64_t maxSize)
+{
+    if (position < 0 || position >= _fileSize || maxSize <= 0) {
+        return 0;
+    }
+    if (position != _position) {
+        seek(position);
+    }
+
+    int64_t bytesRead = 0;
+    while (bytesRead < maxSize && position < _fileSize) {
+        if (_current.length <= 0 || position >= _current.offset + _current.length) {
+            recycle(_current);
+
+            const uint32_t pushed = _blockPushed.value();
+            Block next;
+            if (!_blocks.tryPop(next)) {
+                if (bytesRead > 0 || _stop) {
+                    break;
+                }
+                _blockPushed.wait(pushed, WAIT_TIMEOUT_MS);
+                continue;
+            }
+            _blockTaken.notify();
+
+            if (next.epoch != _epoch.load(std::memory_order_relaxed)) {
+                // Read before a seek
+                recycle(next);
+                continue;
+            }
+            if (next.length < 0) {
+                // Let the next read try again
+                recycle(next);
+                restart(position);
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+            if (position < next.offset) {
+                recycle(next);
+                restart(position);
+                continue;
+            }
+            if (position >= next.offset + next.length) {
+                // Skipped by a short seek forward
+                recycle(next);
+                continue;
+            }
+            _current = std::move(next);
+        }
+
+        const int64_t blockPosition = position - _current.offset;
+        int64_t chunk = qMin(_current.length - blockPosition, maxSize - bytesRead);
+        if (_current.data) {
+            std::memcpy(data + bytesRead, _current.data->data() + blockPosition, static_cast<size_t>(chunk));
+        } else {
+            chunk = readUnbuffered(position, data + bytesRead, chunk);
+            if (chunk <= 0) {
+                recycle(_current);
+                restart(position);
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+        }
+        bytesRead += chunk;
+        position += chunk;
+    }
+
+    _position = position;
+    return bytesRead;
+}
+
+void MdkStreamReader::seek(int64_t position)
+{
+    // The stream will pass a position a short distance ahead by itself
+    const int64_t ahead = position - _position;
+    if (position >= 0 && ahead >= 0 && ahead < static_cast<int64_t>(_blocks.capacity()) * BLOCK_SIZE) {
+        _position = position;
+        return;
+    }
+
+    restart(position);
+}
+
+void MdkStreamReader::restart(int64_t position)
+{
+    recycle(_current);
+    const int64_t start = qBound<int64_t>(0, position, _fileSize);
+    _epochStart.store(start - start % BLOCK_SIZE, std::memory_order_relaxed);
+    _epoch.store(_epoch.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    Block stale;
+    while (_blocks.tryPop(stale)) {
+        recycle(stale);
+    }
+    _blockTaken.notify();
+    _position = start;
+}
+
+void MdkStreamReader::run()
+{
+    uint64_t epoch = ~uint64_t(0);
+    int64_t offset = 0;
+    Block pending;
+    bool havePending = false;
+    std::unique_ptr<MdkBlockArena::Data> spare;
+
+    while (!_stop) {
+        const uint32_t taken = _blockTaken.value();
+        const uint64_t current = _epoch.load(std::memory_order_acquire);
+        if (current != epoch) {
+            epoch = current;
+            offset = _epochStart.load(std::memory_order_relaxed);
+            if (havePending) {
+                spare = std::move(pending.data);
+                havePending = false;
+            }
+        }
+
+        if (!havePending) {
+            if (offset >= _fileSize) {
+                // Nothing left to read until the next seek
+                _blockTaken.wait(taken, WAIT_TIMEOUT_MS);
+                continue;
+            }
+
+            if (!spare && !_spare.tryPop(spare)) {
+                spare = std::make_unique<MdkBlockArena::Data>();
+                if (!spare->allocate(static_cast<size_t>(BLOCK_SIZE))) {
+                    // The arena is full, read() reads the block itself
+                    spare.reset();
+                }
+            }
+            pending.epoch = epoch;
+            pending.offset = offset;
+            pending.data = std::move(spare);
+            pending.length = -1;
+            if (!pending.data) {
+                pending.length = qMin(BLOCK_SIZE, _fileSize - offset);
+            } else if (_file.seek(offset)) {
+                const int64_t length = _file.read(reinterpret_cast<char*>(pending.data->data()), qMin(BLOCK_SIZE, _fileSize - offset));
+                pending.length = (length > 0) ? length : -1;
+            }
+            // After an error wait for read() to seek
+            offset = (pending.length > 0) ? offset + pending.length : _fileSize;
+            havePending = true;
+        }
+
+        if (_blocks.tryPush(pending)) {
+            havePending = false;
+            _blockPushed.notify();
+        } else {
+            _blockTaken.wait(taken, WAIT_TIMEOUT_MS);
+        }
+    }
+}
+
+void MdkStreamReader::recycle(Block &block)
+{
+    // Freed if the spare ring is full
+    if (block.data) {
+        _spare.tryPush(block.data);
+    }
+    block.data.reset();
+    block.length = 0;
+}
+
+int64_t MdkStreamReader::readUnbuffered(int64_t position, uint8_t *data, int64_t length)
+{
+    if (!_readFile) {
+        _readFile = std::make_unique<QFile>(_file.fileName());
+        if (!_readFile->open(QFile::ReadOnly | QFile::Unbuffered)) {
+            _readFile.reset();
+            return -1;
+        }
+    }
+    if (!_readFile->seek(position)) {
+        return -1;
+    }
+    return _readFile->read(reinterpret_cast<char*>(data), length);
+}
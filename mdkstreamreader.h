@@ -0,0 +1,108 @@
+#ifndef MDKSTREAMREADER_H
+#define MDKSTREAMREADER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <QtCore/QFile>
+#include <QtCore/QString>
+
+#include "mdkblockarena.h"
+#include "mdksignal.h"
+#include "mdkspscring.h"
+
+/**
+ * Sequential prefetcher that hands blocks to the reading thread without
+ * locks.
+ *
+ * A background thread reads the file block by block from the last seek
+ * position and pushes the blocks into an MdkSpscRing. read() takes them
+ * from the ring, and only sleeps when it is empty. Consumed buffers go back
+ * to the thread through a second ring, so no memory is allocated once the
+ * rings are full.
+ *
+ * A seek that leaves the stream bumps an epoch. The thread restarts at the
+ * new position as soon as it sees it, and blocks of an older epoch still
+ * in the ring are dropped by read(). Short forward seeks, as done by a
+ * demuxer skipping data, just drop the blocks in between.
+ *
+ * When the MdkBlockArena is full the thread pushes blocks without data,
+ * and read() reads them from the file itself into the caller's buffer.
+ *
+ * Unlike MdkReadAhead, blocks are not kept once read, so seeking back
+ * always goes to the file.
+ */
+class MdkStreamReader
+{
+public:
+    /** Size of a single block */
+    static constexpr int64_t BLOCK_SIZE = MdkBlockArena::BLOCK_SIZE;
+    /** Minimum number of blocks in the ring, regardless of the buffer size */
+    static constexpr int MIN_BLOCK_COUNT = 2;
+    /** Longest a thread sleeps before checking for a stop */
+    static constexpr int WAIT_TIMEOUT_MS = 100;
+
+    /** Create a reader for fileName, buffering about bufferSize bytes. Call start() to start reading. */
+    MdkStreamReader(const QString &fileName, int64_t bufferSize);
+    ~MdkStreamReader();
+
+    MdkStreamReader(const MdkStreamReader &) = delete;
+    MdkStreamReader &operator=(const MdkStreamReader &) = delete;
+
+    /** Open the file and start the reading thread. Returns false if the file cannot be opened. */
+    bool start();
+
+    int64_t size() const { return _fileSize; }
+
+    /**
+     * Read at most maxSize bytes at position. Only to be called from one
+     * thread, the same one calling seek().
+     * \return bytes read, 0 at the end of the file, -1 on a read error.
+     */
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize);
+
+    /** Restart reading at position, unless it is a short distance ahead of the stream */
+    void seek(int64_t position);
+
+private:
+    struct Block {
+        uint64_t epoch = 0;
+        int64_t offset = 0;
+        /** -1 on a read error, 0 for no block */
+        int64_t length = 0;
+        /** Null if there was no memory for the block, read() reads it from the file */
+        std::unique_ptr<MdkBlockArena::Data> data;
+    };
+
+    void restart(int64_t position);
+    void run();
+    void recycle(Block &block);
+    /** Read a block without data on the reading thread */
+    int64_t readUnbuffered(int64_t position, uint8_t *data, int64_t length);
+
+    QFile _file;
+    /** Opened by the reading thread for blocks without data */
+    std::unique_ptr<QFile> _readFile;
+    int64_t _fileSize = 0;
+
+    MdkSpscRing<Block> _blocks;
+    MdkSpscRing<std::unique_ptr<MdkBlockArena::Data>> _spare;
+    /** Notified by the thread when it pushes a block */
+    MdkSignal _blockPushed;
+    /** Notified by read() when it frees a slot, and by seek() */
+    MdkSignal _blockTaken;
+
+    std::atomic<uint64_t> _epoch{0};
+    /** Where the thread starts reading for the current epoch, written before the epoch */
+    std::atomic<int64_t> _epochStart{0};
+    std::atomic<bool> _stop{false};
+
+    /** Owned by the reading thread: the block being read from and the expected read position */
+    Block _current;
+    int64_t _position = 0;
+
+    std::thread _thread;
+};
+
+#endif // MDKSTREAMREADER_H
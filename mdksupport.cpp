@@ -1,7 +1,46 @@
 #include "mdksupport.h"
+#include "mdkaesfileio.h"
+#include "mdkblockarena.h"
+#include "mdkconcatfileio.h"
+#include "mdkhttpfileio.h"
 #include "mdklocalfileio.h"
+#include "mdkmemoryio.h"
+#include "mdkpreloader.h"
+#include "mdktrace.h"
+#include "mdkuringfileio.h"
+#include <QtCore/QUrl>
 
 void registerMediaIoClasses()
 {
     MdkLocalFileIO::registerOnce();
+    MdkMemoryIO::registerOnce();
+    MdkAesFileIO::registerOnce();
+    MdkConcatFileIO::registerOnce();
+    MdkHttpFileIO::registerOnce();
+    MdkUringFileIO::registerOnce();
+}
+
+void setIoEventListener(MDK_NS::MediaEventListener listener)
+{
+    MdkIoStats::setEventListener(std::move(listener));
+}
+
+void preloadUrl(const std::string &url, int64_t budgetBytes)
+{
+    QUrl fileUrl(QString::fromStdString(url));
+    fileUrl.setScheme("file");
+    MdkPreloader::instance().preload(fileUrl.toLocalFile(), budgetBytes);
+}
+
+void setIoMemoryLimit(int64_t bytes)
+{
+    MdkBlockArena::setCapacity(bytes);
+}
+
+bool dumpIoTrace(const QString &fileName)
+{
+    if (fileName.endsWith(".json", Qt::CaseInsensitive)) {
+        return MdkTrace::dumpChromeTrace(fileName);
+    }
+    return MdkTrace::dump(fileName);
 }
@@ -1,6 +1,38 @@
 #ifndef MDKSUPPORT_H
 #define MDKSUPPORT_H
 
+#include <QtCore/QString>
+
+#include "mdkiostats.h"
+
 void registerMediaIoClasses();
 
+/** Receive the "io.stats" events of MdkLocalFileIO urls opened with "stats=<ms>" */
+void setIoEventListener(MDK_NS::MediaEventListener listener);
+
+/**
+ * Start reading the metadata and the start of the local file of url in the
+ * background, using at most budgetBytes of memory, so that playing it next
+ * starts warm. Meant for the next segment of a playlist; the state is
+ * handed to the MdkLocalFileIO that MDK later creates for the same file.
+ */
+void preloadUrl(const std::string &url, int64_t budgetBytes);
+
+/**
+ * Limit the memory used for I/O blocks (read-ahead, caches, direct I/O
+ * buffers) to bytes, 512 MB by default. Must be called before any media
+ * is opened.
+ */
+void setIoMemoryLimit(int64_t bytes);
+
+/**
+ * Write the recent I/O trace to fileName, as a Chrome trace
+ * (chrome://tracing, ui.perfetto.dev) if it ends in ".json" and as text
+ * otherwise. Only what MDK's log level lets through is recorded, and the
+ * per-read and per-seek spans that show the I/O timeline need a build with
+ * DEFINES += MDKIO_TRACE_LEVEL=5 and the log level at All. Returns false if
+ * the file cannot be written.
+ */
+bool dumpIoTrace(const QString &fileName);
+
 #endif // MDKSUPPORT_H
@@ -0,0 +1,191 @@
+#include "mdktrace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <QtCore/QFile>
+#include <QtCore/QtDebug>
+
+namespace {
+
+/**
+ * One ring entry, guarded by a sequence number: odd while being written,
+ * 2 * (index + 1) once record number index is complete.
+ */
+struct Slot {
+    std::atomic<uint64_t> sequence{0};
+    MdkTrace::Record record;
+};
+
+Slot ring[MdkTrace::CAPACITY];
+std::atomic<uint64_t> nextIndex{0};
+
+uint64_t currentThread()
+{
+    static thread_local const uint64_t id = std::hash<std::thread::id>()(std::this_thread::get_id()) & 0xffffffff;
+    return id;
+}
+
+const char *levelName(MDK_NS::LogLevel level)
+{
+    switch (level) {
+    case MDK_NS::Error: return "error";
+    case MDK_NS::Warning: return "warning";
+    case MDK_NS::Info: return "info";
+    case MDK_NS::Debug: return "debug";
+    default: return "trace";
+    }
+}
+
+std::string jsonEscaped(const char *text)
+{
+    std::string escaped;
+    for (const char *c = text; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+            escaped += *c;
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += *c;
+        }
+    }
+    return escaped;
+}
+
+bool write(const QString &fileName, const std::string &contents)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+    return file.write(contents.data(), static_cast<qint64>(contents.size())) == static_cast<qint64>(contents.size());
+}
+
+}
+
+void MdkTrace::message(MDK_NS::LogLevel level, const char *format, ...)
+{
+    Record record;
+    record.timestamp = now();
+    record.level = level;
+
+    // Formatted in full for qDebug(), the ring only keeps the first TEXT_SIZE bytes
+    char text[1024];
+    va_list arguments;
+    va_start(arguments, format);
+    std::vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    std::strncpy(record.text, text, TEXT_SIZE - 1);
+
+    MdkTrace::record(record);
+    if (level <= MDK_NS::Info) {
+        qDebug().noquote() << text;
+    }
+}
+
+void MdkTrace::span(MDK_NS::LogLevel level, const char *name, int64_t start, int64_t duration, int64_t value)
+{
+    Record record;
+    record.timestamp = start;
+    record.duration = duration;
+    record.value = value;
+    record.level = level;
+    std::strncpy(record.text, name, TEXT_SIZE - 1);
+    MdkTrace::record(record);
+}
+
+int64_t MdkTrace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MdkTrace::record(const Record &record)
+{
+    const uint64_t index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = ring[index % CAPACITY];
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.record.thread = currentThread();
+    slot.sequence.store(2 * (index + 1), std::memory_order_release);
+}
+
+std::vector<MdkTrace::Record> MdkTrace::records()
+{
+    std::vector<std::pair<uint64_t, Record>> sorted;
+    sorted.reserve(CAPACITY);
+    for (Slot &slot: ring) {
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before == 0 || before % 2 != 0) {
+            continue;
+        }
+        Record record = slot.record;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == before) {
+            sorted.emplace_back(before, record);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    std::vector<Record> result;
+    result.reserve(sorted.size());
+    for (const auto &entry: sorted) {
+        result.push_back(entry.second);
+    }
+    return result;
+}
+
+bool MdkTrace::dump(const QString &fileName)
+{
+    std::string text;
+    char line[TEXT_SIZE + 96];
+    for (const Record &record: records()) {
+        if (record.duration < 0) {
+            std::snprintf(line, sizeof(line), "%lld %08llx %-7s %s\n",
+                          static_cast<long long>(record.timestamp), static_cast<unsigned long long>(record.thread),
+                          levelName(record.level), record.text);
+        } else {
+            std::snprintf(line, sizeof(line), "%lld %08llx %-7s %s %lld ns value=%lld\n",
+                          static_cast<long long>(record.timestamp), static_cast<unsigned long long>(record.thread),
+                          levelName(record.level), record.text,
+                          static_cast<long long>(record.duration), static_cast<long long>(record.value));
+        }
+        text += line;
+    }
+    return write(fileName, text);
+}
+
+bool MdkTrace::dumpChromeTrace(const QString &fileName)
+{
+    std::string json = "{\"traceEvents\":[";
+    bool first = true;
+    char event[TEXT_SIZE * 2 + 192];
+    for (const Record &record: records()) {
+        const std::string text = jsonEscaped(record.text);
+        const double timestampUs = static_cast<double>(record.timestamp) / 1000.0;
+        if (record.duration < 0) {
+            std::snprintf(event, sizeof(event),
+                          "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%llu}",
+                          text.c_str(), levelName(record.level), timestampUs,
+                          static_cast<unsigned long long>(record.thread));
+        } else {
+            std::snprintf(event, sizeof(event),
+                          "{\"name\":\"%s\",\"cat\":\"io\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu,\"args\":{\"value\":%lld}}",
+                          text.c_str(), timestampUs, static_cast<double>(record.duration) / 1000.0,
+                          static_cast<unsigned long long>(record.thread), static_cast<long long>(record.value));
+        }
+        if (!first) {
+            json += ",\n";
+        }
+        json += event;
+        first = false;
+    }
+    json += "]}\n";
+    return write(fileName, json);
+}
@@ -0,0 +1,145 @@
+#ifndef MDKTRACE_H
+#define MDKTRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <QtCore/QString>
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "global.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/**
+ * Highest MDK_NS::LogLevel compiled in: 0 Off, 1 Error, 2 Warning, 3 Info,
+ * 4 Debug, 5 All. Trace calls above it compile to nothing. The per-read and
+ * per-seek spans are at All, so they are only built with
+ * DEFINES += MDKIO_TRACE_LEVEL=5; otherwise reads don't check the log level.
+ */
+#ifndef MDKIO_TRACE_LEVEL
+#define MDKIO_TRACE_LEVEL 4
+#endif
+
+/**
+ * Level-gated tracing for the I/O layer.
+ *
+ * Messages and spans are only recorded when their level is enabled by MDK's
+ * setLogLevel(), and written into a preallocated ring buffer without
+ * allocating. The ring can be dumped as text, or as a Chrome trace
+ * (chrome://tracing, ui.perfetto.dev) to see the I/O timeline around a
+ * stutter. Messages at Info and above are also passed to qDebug().
+ *
+ * Use the MDKIO_TRACE and MDKIO_TRACE_SPAN macros, not the class directly.
+ */
+class MdkTrace
+{
+public:
+    /** Number of records kept, older ones are overwritten */
+    static constexpr size_t CAPACITY = 16384;
+    /** Maximum length of a message or span name, longer ones are truncated */
+    static constexpr size_t TEXT_SIZE = 112;
+
+    struct Record {
+        /** Nanoseconds on the steady clock */
+        int64_t timestamp = 0;
+        /** Nanoseconds, -1 for messages */
+        int64_t duration = -1;
+        /** Free argument of a span, e.g. the number of bytes read */
+        int64_t value = 0;
+        uint64_t thread = 0;
+        MDK_NS::LogLevel level = MDK_NS::Off;
+        char text[TEXT_SIZE] = {};
+    };
+
+    /** Whether level is compiled in and enabled at runtime */
+    static bool enabled(MDK_NS::LogLevel level) { return level <= MDKIO_TRACE_LEVEL && level <= MDK_NS::logLevel(); }
+
+    /** Record a printf-style message */
+    static void message(MDK_NS::LogLevel level, const char *format, ...)
+#if defined __GNUC__ || defined __clang__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+    /** Record a completed span */
+    static void span(MDK_NS::LogLevel level, const char *name, int64_t start, int64_t duration, int64_t value);
+
+    /** Nanoseconds on the steady clock */
+    static int64_t now();
+
+    /** The records in the ring, oldest first */
+    static std::vector<Record> records();
+
+    /** Write the records as text, one per line */
+    static bool dump(const QString &fileName);
+
+    /** Write the records in the Chrome trace event format */
+    static bool dumpChromeTrace(const QString &fileName);
+
+private:
+    static void record(const Record &record);
+};
+
+/** Records the lifetime of a scope as a span, if level is enabled when it starts */
+class MdkTraceSpan
+{
+public:
+    MdkTraceSpan(MDK_NS::LogLevel level, const char *name):
+        _level(level),
+        _name(name),
+        _start(MdkTrace::enabled(level) ? MdkTrace::now() : -1)
+    {
+        // empty
+    }
+
+    ~MdkTraceSpan()
+    {
+        if (_start >= 0) {
+            MdkTrace::span(_level, _name, _start, MdkTrace::now() - _start, _value);
+        }
+    }
+
+    MdkTraceSpan(const MdkTraceSpan &) = delete;
+    MdkTraceSpan &operator=(const MdkTraceSpan &) = delete;
+
+    /** Set the value shown with the span, e.g. the result of the traced call */
+    void setValue(int64_t value) { _value = value; }
+
+private:
+    const MDK_NS::LogLevel _level;
+    const char *const _name;
+    const int64_t _start;
+    int64_t _value = 0;
+};
+
+/** Level-gated message: MDKIO_TRACE(MDK_NS::Info, "Opening %s", qPrintable(fileName)) */
+#define MDKIO_TRACE(level, ...) \
+    do { \
+        if (MdkTrace::enabled(level)) { \
+            MdkTrace::message(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+/**
+ * Declare a span variable for the rest of the scope, at level All:
+ * MDKIO_TRACE_SPAN(span, "read"); ... MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+ */
+#if MDKIO_TRACE_LEVEL >= 5
+#define MDKIO_TRACE_SPAN(variable, name) MdkTraceSpan variable(MDK_NS::All, name)
+#define MDKIO_TRACE_SPAN_VALUE(variable, value) variable.setValue(value)
+#else
+#define MDKIO_TRACE_SPAN(variable, name) do {} while (0)
+#define MDKIO_TRACE_SPAN_VALUE(variable, value) do {} while (0)
+#endif
+
+#endif // MDKTRACE_H
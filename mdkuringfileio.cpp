@@ -0,0 +1,445 @@
+#include "mdkuringfileio.h"
+#include "mdktrace.h"
+#include <array>
+#include <cstring>
+#include <vector>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QUrl>
+
+#if defined HAVE_LIBURING
+#include <liburing.h>
+
+class MdkUringFileIO::Ring
+{
+public:
+    Ring(MdkUringFileIO &io, int fd, int64_t fileSize):
+        _io(io),
+        _fd(fd),
+        _fileSize(fileSize)
+    {
+        // empty
+    }
+
+    ~Ring()
+    {
+        if (!_initialized) {
+            return;
+        }
+        // The kernel may still write into our buffers until every read has completed
+        cancelAll();
+        while (inFlight() && reap(true)) {
+            // waiting
+        }
+        io_uring_queue_exit(&_ring);
+    }
+
+    bool init()
+    {
+        if (io_uring_queue_init(2 * QUEUE_DEPTH, &_ring, 0) < 0) {
+            return false;
+        }
+        _initialized = true;
+
+        _buffers.resize(QUEUE_DEPTH * READ_SIZE);
+        std::array<iovec, QUEUE_DEPTH> iovecs;
+        for (unsigned i = 0; i < QUEUE_DEPTH; ++i) {
+            iovecs[i].iov_base = buffer(i);
+            iovecs[i].iov_len = READ_SIZE;
+        }
+        // Registering fails when RLIMIT_MEMLOCK is too low, plain reads still work then
+        _registered = io_uring_register_buffers(&_ring, iovecs.data(), QUEUE_DEPTH) == 0;
+        return true;
+    }
+
+    int64_t read(int64_t position, uint8_t *data, int64_t maxSize)
+    {
+        if (position >= _fileSize) {
+            return 0;
+        }
+        fillWindow(position);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        int64_t bytesRead = 0;
+        while (bytesRead < maxSize && position < _fileSize) {
+            reap(false);
+
+            const int64_t blockOffset = position - position % READ_SIZE;
+            Slot &slot = slotFor(blockOffset);
+            if (slot.offset != blockOffset || slot.state == State::Empty) {
+                fillWindow(position);
+            }
+            if (slot.offset != blockOffset || slot.state == State::Empty || slot.state == State::InFlight) {
+                // Only wait for the block if we have nothing to return yet
+                if (bytesRead > 0) {
+                    break;
+                }
+                if (_io.interrupted(timer.elapsed())) {
+                    cancelAll();
+                    return -1;
+                }
+                if (!reap(true)) {
+                    return -1;
+                }
+                continue;
+            }
+            if (slot.state == State::Failed) {
+                return bytesRead > 0 ? bytesRead : -1;
+            }
+
+            const int64_t blockPosition = position - blockOffset;
+            const int64_t chunk = qMin(slot.length - blockPosition, maxSize - bytesRead);
+            if (chunk <= 0) {
+                break;
+            }
+            std::memcpy(data + bytesRead, buffer(slot) + blockPosition, static_cast<size_t>(chunk));
+            bytesRead += chunk;
+            position += chunk;
+        }
+
+        // Blocks we just finished with can be reused further ahead
+        fillWindow(position);
+        return bytesRead;
+    }
+
+    void seek(int64_t position)
+    {
+        for (Slot &slot: _slots) {
+            if (slot.state == State::Failed) {
+                slot.state = State::Empty;
+            }
+        }
+        fillWindow(position);
+    }
+
+    void cancelAll()
+    {
+        for (Slot &slot: _slots) {
+            cancel(slot);
+        }
+        io_uring_submit(&_ring);
+    }
+
+private:
+    /** user_data of cancel requests, never used for reads */
+    static constexpr uint64_t CANCEL_USER_DATA = ~uint64_t(0);
+
+    enum class State {
+        Empty,
+        InFlight,
+        Ready,
+        Failed
+    };
+
+    struct Slot {
+        State state = State::Empty;
+        int64_t offset = -1;
+        int64_t length = 0;
+        uint64_t tag = 0;
+        bool cancelled = false;
+    };
+
+    size_t index(const Slot &slot) const { return static_cast<size_t>(&slot - _slots.data()); }
+    uint8_t *buffer(size_t index) { return _buffers.data() + index * READ_SIZE; }
+    uint8_t *buffer(const Slot &slot) { return buffer(index(slot)); }
+    Slot &slotFor(int64_t offset) { return _slots[static_cast<size_t>((offset / READ_SIZE) % QUEUE_DEPTH)]; }
+
+    bool inFlight() const
+    {
+        for (const Slot &slot: _slots) {
+            if (slot.state == State::InFlight) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    io_uring_sqe *nextSqe()
+    {
+        io_uring_sqe *sqe = io_uring_get_sqe(&_ring);
+        if (sqe == nullptr) {
+            // Submission queue is full, make room
+            io_uring_submit(&_ring);
+            sqe = io_uring_get_sqe(&_ring);
+        }
+        return sqe;
+    }
+
+    /** Queue reads for every block in the window starting at position, and cancel those outside of it */
+    void fillWindow(int64_t position)
+    {
+        const int64_t windowStart = position - position % READ_SIZE;
+        bool queued = false;
+        for (unsigned i = 0; i < QUEUE_DEPTH; ++i) {
+            const int64_t offset = windowStart + i * READ_SIZE;
+            if (offset >= _fileSize) {
+                break;
+            }
+            Slot &slot = slotFor(offset);
+            if (slot.offset == offset && slot.state != State::Empty) {
+                continue;
+            }
+            if (slot.state == State::InFlight) {
+                // Still reading a block outside the window, the buffer is ours again once it completes
+                queued |= cancel(slot);
+                continue;
+            }
+            queued |= submitRead(slot, offset);
+        }
+        if (queued) {
+            io_uring_submit(&_ring);
+        }
+    }
+
+    bool submitRead(Slot &slot, int64_t offset)
+    {
+        io_uring_sqe *sqe = nextSqe();
+        if (sqe == nullptr) {
+            return false;
+        }
+
+        const unsigned length = static_cast<unsigned>(qMin(READ_SIZE, _fileSize - offset));
+        if (_registered) {
+            io_uring_prep_read_fixed(sqe, _fd, buffer(slot), length, static_cast<uint64_t>(offset), static_cast<int>(index(slot)));
+        } else {
+            io_uring_prep_read(sqe, _fd, buffer(slot), length, static_cast<uint64_t>(offset));
+        }
+        slot.tag = ++_nextTag;
+        slot.offset = offset;
+        slot.length = 0;
+        slot.state = State::InFlight;
+        slot.cancelled = false;
+        io_uring_sqe_set_data64(sqe, (slot.tag << 8) | index(slot));
+        return true;
+    }
+
+    bool cancel(Slot &slot)
+    {
+        if (slot.state != State::InFlight || slot.cancelled) {
+            return false;
+        }
+        io_uring_sqe *sqe = nextSqe();
+        if (sqe == nullptr) {
+            return false;
+        }
+        io_uring_prep_cancel64(sqe, (slot.tag << 8) | index(slot), 0);
+        io_uring_sqe_set_data64(sqe, CANCEL_USER_DATA);
+        slot.cancelled = true;
+        return true;
+    }
+
+    /** Process completed reads, waiting up to WAIT_INTERVAL_MS for one if wait is set */
+    bool reap(bool wait)
+    {
+        io_uring_cqe *cqe = nullptr;
+        if (wait) {
+            __kernel_timespec timeout{0, WAIT_INTERVAL_MS * 1000 * 1000};
+            const int result = io_uring_wait_cqe_timeout(&_ring, &cqe, &timeout);
+            if (result < 0 && result != -ETIME && result != -EINTR) {
+                return false;
+            }
+        }
+        while (io_uring_peek_cqe(&_ring, &cqe) == 0) {
+            complete(io_uring_cqe_get_data64(cqe), cqe->res);
+            io_uring_cqe_seen(&_ring, cqe);
+        }
+        return true;
+    }
+
+    void complete(uint64_t userData, int result)
+    {
+        if (userData == CANCEL_USER_DATA) {
+            return;
+        }
+        Slot &slot = _slots[userData & 0xff];
+        if (slot.state != State::InFlight || slot.tag != (userData >> 8)) {
+            return;
+        }
+        if (result >= 0) {
+            // Even if cancelled too late, the data is valid for slot.offset
+            slot.length = result;
+            slot.state = State::Ready;
+        } else if (result == -ECANCELED || result == -EINTR) {
+            slot.state = State::Empty;
+        } else {
+            slot.state = State::Failed;
+        }
+    }
+
+    MdkUringFileIO &_io;
+    const int _fd;
+    const int64_t _fileSize;
+
+    io_uring _ring;
+    bool _initialized = false;
+    bool _registered = false;
+    std::vector<uint8_t> _buffers;
+    std::array<Slot, QUEUE_DEPTH> _slots;
+    uint64_t _nextTag = 0;
+};
+
+#else
+
+// Without liburing there is no ring, MdkUringFileIO always uses QFile
+class MdkUringFileIO::Ring
+{
+public:
+    Ring(MdkUringFileIO &, int, int64_t) {}
+    bool init() { return false; }
+    int64_t read(int64_t, uint8_t *, int64_t) { return -1; }
+    void seek(int64_t) {}
+};
+
+#endif
+
+MdkUringFileIO::MdkUringFileIO():
+    mdk::MediaIO()
+{
+    // empty
+}
+
+MdkUringFileIO::~MdkUringFileIO()
+{
+    // The ring reads from the file's descriptor, so it has to go first
+    _ring.reset();
+}
+
+void MdkUringFileIO::registerOnce()
+{
+    MDKIO_TRACE(MDK_NS::Debug, "Registering MdkUringFileIO");
+    MediaIO::registerOnce(NAME, []{ return new MdkUringFileIO();});
+}
+
+const char *MdkUringFileIO::name() const
+{
+    return NAME;
+}
+
+const std::set<std::string> &MdkUringFileIO::protocols() const {
+    static const std::set<std::string> s{PROTOCOL};
+    return s;
+}
+
+int64_t MdkUringFileIO::read(uint8_t *data, int64_t maxSize)
+{
+    MDKIO_TRACE_SPAN(span, "read");
+    if (!_videoFile || !_videoFile->isOpen() || _aborted) {
+        return _aborted ? -1 : 0;
+    }
+
+    int64_t bytesRead = 0;
+    if (_ring) {
+        bytesRead = _ring->read(_position, data, maxSize);
+    } else {
+        if (_videoFile->pos() != _position && !_videoFile->seek(_position)) {
+            return -1;
+        }
+        bytesRead = _videoFile->read(reinterpret_cast<char*>(data), maxSize);
+    }
+    if (bytesRead > 0) {
+        _position += bytesRead;
+    }
+    MDKIO_TRACE_SPAN_VALUE(span, bytesRead);
+    return bytesRead;
+}
+
+bool MdkUringFileIO::seek(int64_t offset, int from)
+{
+    MDKIO_TRACE_SPAN(span, "seek");
+    if (!_videoFile || !_videoFile->isOpen()) {
+        return false;
+    }
+
+    qint64 position = offset;
+    if (from == SEEK_CUR) {
+        position += _position;
+    } else if (from == SEEK_END) {
+        position += size();
+    }
+    if (position < 0 || position > size()) {
+        return false;
+    }
+
+    _aborted = false;
+    _position = position;
+    MDKIO_TRACE_SPAN_VALUE(span, position);
+    if (_ring) {
+        _ring->seek(position);
+    }
+    return true;
+}
+
+int64_t MdkUringFileIO::position() const
+{
+    return _position;
+}
+
+int64_t MdkUringFileIO::size() const
+{
+    if (!_videoFile || !_videoFile->isOpen()) {
+        return 0;
+    }
+    return _videoFile->size();
+}
+
+bool MdkUringFileIO::abort()
+{
+    // Picked up by the reading thread within WAIT_INTERVAL_MS, which then cancels its reads
+    _aborted = true;
+    return true;
+}
+
+bool MdkUringFileIO::setTimeout(int64_t ms, MDK_NS::TimeoutCallback callback)
+{
+    _timeout = ms;
+    _timeoutCallback = std::move(callback);
+    return true;
+}
+
+bool MdkUringFileIO::interrupted(int64_t elapsedMs)
+{
+    if (_aborted) {
+        return true;
+    }
+    if (_timeout < 0 || elapsedMs < _timeout) {
+        return false;
+    }
+    return !_timeoutCallback || _timeoutCallback(elapsedMs);
+}
+
+bool MdkUringFileIO::onUrlChanged()
+{
+    MDKIO_TRACE_SPAN(span, "open");
+
+    _ring.reset();
+    _position = 0;
+    _aborted = false;
+
+    if (_videoFile != nullptr) {
+        _videoFile->close();
+        _videoFile.reset();
+    }
+
+    if (url().empty())
+        return true;
+
+    QUrl protocolUrl(QUrl(QString::fromStdString(url())));
+    protocolUrl.setScheme("file");
+
+    _videoFile = std::make_unique<QFile>(protocolUrl.toLocalFile());
+
+    MDKIO_TRACE(MDK_NS::Info, "Uringfile: Opening %s", qPrintable(_videoFile->fileName()));
+    if (!_videoFile->open(QFile::ReadOnly | QFile::Unbuffered)) {
+        MDKIO_TRACE(MDK_NS::Warning, "Unable to open %s", qPrintable(_videoFile->fileName()));
+        _videoFile.reset();
+        return false;
+    }
+
+    _ring = std::make_unique<Ring>(*this, _videoFile->handle(), _videoFile->size());
+    if (!_ring->init()) {
+        MDKIO_TRACE(MDK_NS::Info, "io_uring not available, reading %s with QFile", qPrintable(_videoFile->fileName()));
+        _ring.reset();
+    }
+    return true;
+}
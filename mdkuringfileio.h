@@ -0,0 +1,100 @@
+#ifndef MDKURINGFILEIO_H
+#define MDKURINGFILEIO_H
+
+#include <atomic>
+#include <set>
+#include <QtCore/QFile>
+
+#if defined __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#elif defined __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#endif
+#include "MediaIO.h"
+#if defined __GNUC__
+#pragma GCC diagnostic pop
+#elif defined __clang__
+#pragma clang diagnostic pop
+#endif
+
+/**
+ * Local file MediaIO that reads through io_uring, for urls like
+ * uringfile:///videos/ride.mp4
+ *
+ * A window of QUEUE_DEPTH blocks ahead of the read position is kept in
+ * flight as batched asynchronous reads into registered buffers, so read()
+ * only waits when the block it needs has not completed yet. When io_uring
+ * is not available (no liburing at build time, or an old kernel) it falls
+ * back to plain QFile reads.
+ */
+class MdkUringFileIO: public MDK_NS::MediaIO
+{
+public:
+    static constexpr char const * NAME = "MdkUringFileIO";
+    static constexpr char const * PROTOCOL = "uringfile";
+
+    /** Number of blocks kept in flight ahead of the read position */
+    static constexpr unsigned QUEUE_DEPTH = 16;
+    /** Size of a single read */
+    static constexpr int64_t READ_SIZE = 256 * 1024;
+    /** How often a waiting read checks for abort() and timeouts */
+    static constexpr int64_t WAIT_INTERVAL_MS = 20;
+
+    MdkUringFileIO();
+
+    ~MdkUringFileIO() override;
+
+    static void registerOnce();
+
+    const char* name() const override;
+
+    const std::set<std::string> &protocols() const override;
+
+    /** Always seekable! */
+    bool isSeekable() const override { return true; }
+    /** We don't need or want any writing done */
+    bool isWritable() const override { return false; }
+
+    /** Reading from file */
+    int64_t read(uint8_t *data, int64_t maxSize) override;
+
+    /** No writing is possible */
+    int64_t write(const uint8_t *, int64_t) override { return 0; }
+
+    /** Seek in file, cancelling reads that fall outside the new window */
+    bool seek(int64_t offset, int from = SEEK_SET) override;
+
+    /** Get the current position */
+    int64_t position() const override;
+
+    /** Get the size of the video file */
+    int64_t size() const override;
+
+    /** Cancel outstanding reads. Reads fail until the next seek() or url change. */
+    bool abort() override;
+
+    /** Give up waiting for a read after ms milliseconds, unless callback returns false */
+    bool setTimeout(int64_t ms, MDK_NS::TimeoutCallback callback) override;
+
+    /** True if reads go through io_uring, false if falling back to QFile */
+    bool isUsingUring() const { return _ring != nullptr; }
+
+protected:
+    bool onUrlChanged() override;
+private:
+    class Ring;
+
+    /** Whether a read that has been waiting for elapsedMs should give up */
+    bool interrupted(int64_t elapsedMs);
+
+    std::unique_ptr<QFile> _videoFile;
+    std::unique_ptr<Ring> _ring;
+    int64_t _position = 0;
+    std::atomic<bool> _aborted{false};
+    int64_t _timeout = MDK_NS::kTimeout;
+    MDK_NS::TimeoutCallback _timeoutCallback;
+};
+
+#endif // MDKURINGFILEIO_H